@@ -0,0 +1,203 @@
+/**
+ * @file ColumnarFile.h
+ * @brief A memory-mappable columnar format for irfTuple output, and
+ * a reader for it.
+ *
+ * The file is a ColumnarHeader, one ColumnarField per column, and
+ * then the columns, each a contiguous array of native-endian float or
+ * double values starting at a 64-byte boundary:
+ *
+ * @verbatim
+   offset 0      ColumnarHeader (32 bytes)
+   offset 32     ColumnarField[ncols] (64 bytes each)
+   field.offset  nrows values of column k, for each k
+   @endverbatim
+ *
+ * The reader is defined here in full so that analysis code can use
+ * it without linking to fitsGenApps.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_ColumnarFile_h
+#define fitsGenApps_ColumnarFile_h
+
+#include <stdint.h>
+
+#include <cstring>
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fitsGenApps {
+
+struct ColumnarHeader {
+   enum {ORDER_MARK = 0x01020304, FORMAT_VERSION = 1, COLUMN_ALIGNMENT = 64};
+/// "IRFCOLS" and a terminating null
+   char magic[8];
+/// ORDER_MARK as written, to detect a reader of the other byte order
+   uint32_t byte_order;
+   uint32_t version;
+   uint64_t nrows;
+   uint64_t ncols;
+
+   static const char * magicString() {
+      return "IRFCOLS";
+   }
+
+   /// Size rounded up to a multiple of COLUMN_ALIGNMENT.
+   static uint64_t aligned(uint64_t size) {
+      return (size + COLUMN_ALIGNMENT - 1)/COLUMN_ALIGNMENT*COLUMN_ALIGNMENT;
+   }
+};
+
+struct ColumnarField {
+   enum Type {FLOAT32 = 0, FLOAT64 = 1};
+/// Null-terminated column name
+   char name[48];
+   uint32_t type;
+   uint32_t reserved;
+/// Offset of the column's first value from the start of the file
+   uint64_t offset;
+
+   static size_t elementSize(uint32_t type) {
+      return type == FLOAT32 ? 4 : 8;
+   }
+};
+
+/**
+ * @class ColumnarReader
+ * @brief Read-only memory map of a columnar file.  The column
+ * pointers refer directly to the mapped file, and remain valid for
+ * the lifetime of the reader.
+ */
+
+class ColumnarReader {
+
+public:
+
+   ColumnarReader(const std::string & filename);
+
+   ~ColumnarReader() throw() {
+      munmap(const_cast<char *>(m_data), m_size);
+   }
+
+   uint64_t nrows() const {
+      return m_header->nrows;
+   }
+
+   size_t ncols() const {
+      return m_header->ncols;
+   }
+
+   std::string name(size_t col) const {
+      return m_fields[col].name;
+   }
+
+   /// @return The index of a column, or throw if there is none.
+   size_t columnIndex(const std::string & name) const;
+
+   /// Values of a FLOAT32 column.
+   const float * floatColumn(const std::string & name) const {
+      return reinterpret_cast<const float *>(column(name,
+                                                    ColumnarField::FLOAT32));
+   }
+
+   /// Values of a FLOAT64 column.
+   const double * doubleColumn(const std::string & name) const {
+      return reinterpret_cast<const double *>(column(name,
+                                                     ColumnarField::FLOAT64));
+   }
+
+private:
+
+   std::string m_filename;
+   const char * m_data;
+   size_t m_size;
+   const ColumnarHeader * m_header;
+   const ColumnarField * m_fields;
+
+   const char * column(const std::string & name, uint32_t type) const;
+
+   ColumnarReader(const ColumnarReader &);
+   ColumnarReader & operator=(const ColumnarReader &);
+
+};
+
+inline ColumnarReader::ColumnarReader(const std::string & filename)
+   : m_filename(filename), m_data(0), m_size(0), m_header(0), m_fields(0) {
+   int fd(open(m_filename.c_str(), O_RDONLY));
+   if (fd < 0) {
+      throw std::runtime_error("ColumnarReader: cannot open " + m_filename);
+   }
+   struct stat buf;
+   void * addr(MAP_FAILED);
+   if (fstat(fd, &buf) == 0 && buf.st_size >= off_t(sizeof(ColumnarHeader))) {
+      m_size = buf.st_size;
+      addr = mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (addr == MAP_FAILED) {
+      throw std::runtime_error("ColumnarReader: cannot map " + m_filename);
+   }
+   m_data = static_cast<const char *>(addr);
+   m_header = reinterpret_cast<const ColumnarHeader *>(m_data);
+   m_fields = reinterpret_cast<const ColumnarField *>(m_header + 1);
+
+   std::string error;
+   if (std::memcmp(m_header->magic, ColumnarHeader::magicString(),
+                   sizeof(m_header->magic)) != 0) {
+      error = "not a columnar file";
+   } else if (m_header->byte_order != ColumnarHeader::ORDER_MARK) {
+      error = "written with the other byte order";
+   } else if (m_header->version != ColumnarHeader::FORMAT_VERSION) {
+      error = "unsupported version";
+   } else if (m_header->ncols > m_size/sizeof(ColumnarField)
+              || sizeof(ColumnarHeader)
+              + m_header->ncols*sizeof(ColumnarField) > m_size) {
+      error = "truncated header";
+   } else {
+      for (size_t k(0); k < m_header->ncols && error == ""; k++) {
+         uint64_t size(ColumnarField::elementSize(m_fields[k].type));
+         if (m_fields[k].offset > m_size
+             || m_header->nrows > (m_size - m_fields[k].offset)/size) {
+            error = "truncated data";
+         }
+      }
+   }
+   if (error != "") {
+      munmap(const_cast<char *>(m_data), m_size);
+      throw std::runtime_error("ColumnarReader: " + m_filename + ": " + error);
+   }
+}
+
+inline size_t ColumnarReader::columnIndex(const std::string & name) const {
+   for (size_t k(0); k < m_header->ncols; k++) {
+      if (name == m_fields[k].name) {
+         return k;
+      }
+   }
+   throw std::runtime_error("ColumnarReader: no column " + name + " in "
+                            + m_filename);
+}
+
+inline const char * ColumnarReader::column(const std::string & name,
+                                           uint32_t type) const {
+   const ColumnarField & field(m_fields[columnIndex(name)]);
+   if (field.type != type) {
+      throw std::runtime_error("ColumnarReader: column " + name
+                               + " has a different type.");
+   }
+   return m_data + field.offset;
+}
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_ColumnarFile_h
@@ -0,0 +1,61 @@
+/**
+ * @file AeffTable.cxx
+ * @brief Effective area sampled on a grid of instrument coordinates.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "irfInterface/IAeff.h"
+
+#include "AeffTable.h"
+
+namespace fitsGenApps {
+
+const double AeffTable::s_theta_step(0.5);
+const double AeffTable::s_phi_step(5.);
+const size_t AeffTable::s_ntheta(361);
+const size_t AeffTable::s_nphi(73);
+
+AeffTable::AeffTable(const irfInterface::IAeff & aeff, double energy)
+   : m_values(s_ntheta*s_nphi) {
+// The last phi node duplicates the first, so that phi near 360 deg
+// interpolates without wrapping around.
+   for (size_t i(0); i < s_ntheta; i++) {
+      for (size_t j(0); j < s_nphi; j++) {
+         m_values[i*s_nphi + j] = aeff.value(energy, i*s_theta_step,
+                                             j*s_phi_step);
+      }
+   }
+}
+
+void AeffTable::values(const std::vector<double> & theta,
+                       const std::vector<double> & phi,
+                       std::vector<double> & aeff) const {
+   if (phi.size() != theta.size()) {
+      throw std::runtime_error("AeffTable::values: theta and phi "
+                               "columns differ in length.");
+   }
+   size_t n(theta.size());
+   aeff.resize(n);
+   for (size_t k(0); k < n; k++) {
+      double x(std::min(std::max(theta[k]/s_theta_step, 0.),
+                        s_ntheta - 1.));
+      double y(std::min(std::max(phi[k]/s_phi_step, 0.), s_nphi - 1.));
+      size_t i(std::min(static_cast<size_t>(x), s_ntheta - 2));
+      size_t j(std::min(static_cast<size_t>(y), s_nphi - 2));
+      double u(x - i);
+      double v(y - j);
+      const double * row(&m_values[i*s_nphi + j]);
+      aeff[k] = (1. - u)*((1. - v)*row[0] + v*row[1])
+         + u*((1. - v)*row[s_nphi] + v*row[s_nphi + 1]);
+   }
+}
+
+} // namespace fitsGenApps
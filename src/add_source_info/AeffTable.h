@@ -0,0 +1,55 @@
+/**
+ * @file AeffTable.h
+ * @brief Effective area sampled on a grid of instrument coordinates.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_AeffTable_h
+#define fitsGenApps_AeffTable_h
+
+#include <vector>
+
+namespace irfInterface {
+   class IAeff;
+}
+
+namespace fitsGenApps {
+
+/**
+ * @class AeffTable
+ * @brief Effective area at a fixed energy, evaluated once on a grid
+ * of 0.5 deg in theta by 5 deg in phi and bilinearly interpolated
+ * thereafter, so that the IRF is not evaluated for every FT2 row of
+ * every source.
+ */
+
+class AeffTable {
+
+public:
+
+   /// @param aeff Effective area of the chosen IRFs
+   /// @param energy Energy (MeV) at which to evaluate it
+   AeffTable(const irfInterface::IAeff & aeff, double energy);
+
+   /// Effective area (cm^2) for each pair of theta and phi (deg).
+   void values(const std::vector<double> & theta,
+               const std::vector<double> & phi,
+               std::vector<double> & aeff) const;
+
+private:
+
+   std::vector<double> m_values;
+
+   static const double s_theta_step;
+   static const double s_phi_step;
+   static const size_t s_ntheta;
+   static const size_t s_nphi;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_AeffTable_h
@@ -0,0 +1,93 @@
+/**
+ * @file ColumnTable.cxx
+ * @brief Whole-column access to a FITS binary table.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <stdexcept>
+
+#include "ColumnTable.h"
+
+namespace fitsGenApps {
+
+ColumnTable::ColumnTable(const std::string & filename,
+                         const std::string & extname)
+   : m_filename(filename), m_fptr(0), m_nrows(0) {
+   int status(0);
+   fits_open_file(&m_fptr, m_filename.c_str(), READWRITE, &status);
+   checkStatus(status, "opening");
+   fits_movnam_hdu(m_fptr, BINARY_TBL, const_cast<char *>(extname.c_str()),
+                   0, &status);
+   if (status != 0) {
+      int close_status(0);
+      fits_close_file(m_fptr, &close_status);
+      m_fptr = 0;
+   }
+   checkStatus(status, "finding extension " + extname);
+   fits_get_num_rows(m_fptr, &m_nrows, &status);
+   checkStatus(status, "getting number of rows");
+}
+
+ColumnTable::~ColumnTable() throw() {
+   int status(0);
+   if (m_fptr) {
+      fits_close_file(m_fptr, &status);
+   }
+}
+
+void ColumnTable::close() {
+   if (m_fptr == 0) {
+      return;
+   }
+   int status(0);
+   fits_close_file(m_fptr, &status);
+   m_fptr = 0;
+   checkStatus(status, "closing");
+}
+
+int ColumnTable::columnNumber(const std::string & fieldName) const {
+   int status(0);
+   int colnum(0);
+   fits_get_colnum(m_fptr, CASEINSEN, const_cast<char *>(fieldName.c_str()),
+                   &colnum, &status);
+   checkStatus(status, "finding column " + fieldName);
+   return colnum;
+}
+
+void ColumnTable::read(int colnum, long first, long nrows,
+                       std::vector<double> & values) const {
+   values.resize(nrows);
+   if (nrows == 0) {
+      return;
+   }
+   int status(0);
+   int anynul(0);
+   fits_read_col(m_fptr, TDOUBLE, colnum, first + 1, 1, nrows, 0,
+                 &values[0], &anynul, &status);
+   checkStatus(status, "reading column");
+}
+
+void ColumnTable::write(int colnum, long first,
+                        const std::vector<double> & values) {
+   if (values.empty()) {
+      return;
+   }
+   int status(0);
+   fits_write_col(m_fptr, TDOUBLE, colnum, first + 1, 1, values.size(),
+                  const_cast<double *>(&values[0]), &status);
+   checkStatus(status, "writing column");
+}
+
+void ColumnTable::checkStatus(int status, const std::string & message) const {
+   if (status != 0) {
+      char text[FLEN_STATUS];
+      fits_get_errstatus(status, text);
+      throw std::runtime_error("ColumnTable: " + message + " in "
+                               + m_filename + ": " + text);
+   }
+}
+
+} // namespace fitsGenApps
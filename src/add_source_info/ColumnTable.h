@@ -0,0 +1,67 @@
+/**
+ * @file ColumnTable.h
+ * @brief Whole-column access to a FITS binary table.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_ColumnTable_h
+#define fitsGenApps_ColumnTable_h
+
+#include <string>
+#include <vector>
+
+#include "fitsio.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class ColumnTable
+ * @brief Read and write ranges of rows of scalar columns as arrays,
+ * with one cfitsio call per column and range, rather than per cell
+ * as with tip iterators.  Rows are numbered from zero.
+ */
+
+class ColumnTable {
+
+public:
+
+   /// Open the extension extname of filename for reading and writing.
+   ColumnTable(const std::string & filename, const std::string & extname);
+
+   /// Closes the file if close() has not been called, ignoring errors.
+   ~ColumnTable() throw();
+
+   /// Close the file, flushing the rows written.  Errors, e.g., a full
+   /// disk, are reported as exceptions.
+   void close();
+
+   long nrows() const {
+      return m_nrows;
+   }
+
+   /// Column number of a field; the name is not case-sensitive.
+   int columnNumber(const std::string & fieldName) const;
+
+   /// Read nrows values of a column, starting at row first.
+   void read(int colnum, long first, long nrows,
+             std::vector<double> & values) const;
+
+   /// Write the values to a column, starting at row first.
+   void write(int colnum, long first, const std::vector<double> & values);
+
+private:
+
+   std::string m_filename;
+   fitsfile * m_fptr;
+   long m_nrows;
+
+   void checkStatus(int status, const std::string & message) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_ColumnTable_h
@@ -6,6 +6,7 @@
  * $Header$
  */
 
+#include <cerrno>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -13,6 +14,18 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "facilities/Util.h"
 
 #include "st_stream/StreamFormatter.h"
 
@@ -25,9 +38,38 @@
 
 #include "astro/SkyDir.h"
 
-// #include "irfInterface/IrfsFactory.h"
-// #include "irfInterface/Irfs.h"
-// #include "irfLoader/Loader.h"
+#include "st_facilities/FitsUtil.h"
+#include "st_facilities/Util.h"
+
+#include "common/SkyGeometry.h"
+
+#include "AeffTable.h"
+#include "ColumnTable.h"
+
+#include "irfInterface/IrfsFactory.h"
+#include "irfInterface/Irfs.h"
+#include "irfLoader/Loader.h"
+
+namespace {
+/// A source for which theta and phi columns are added, with its
+/// direction as a unit vector.
+   struct Source {
+      Source(const std::string & srcName, double ra, double dec) 
+         : name(srcName) {
+         const CLHEP::Hep3Vector & dir(astro::SkyDir(ra, dec).dir());
+         x = dir.x();
+         y = dir.y();
+         z = dir.z();
+      }
+      std::string name;
+      double x;
+      double y;
+      double z;
+   };
+
+/// Space for the error message of each file processed in a worker.
+   const size_t message_size(256);
+} // anonymous namespace
 
 /**
  * @class SourceInfo
@@ -42,6 +84,7 @@ public:
 
    virtual ~SourceInfo() throw() {
       try {
+         delete m_aeffTable;
          delete m_formatter;
       } catch (std::exception & eObj) {
          std::cerr << eObj.what() << std::endl;
@@ -59,13 +102,21 @@ private:
    st_stream::StreamFormatter * m_formatter;
    st_app::AppParGroup & m_pars;
 
-   astro::SkyDir m_srcDir;
+   std::vector<Source> m_sources;
+
+   std::string m_sctable;
+   bool m_clobber;
+   bool m_add_exposure;
+   fitsGenApps::AeffTable * m_aeffTable;
 
    static std::string s_cvs_id;
 
    void promptForParameters();
+   void readSourceList(const std::string & srclist);
+   void setUpAeff();
+   void processFiles(const std::vector<std::string> & scfiles) const;
    void appendField(tip::Table * sctable, const std::string & fieldName) const;
-   void addColumns();
+   void addColumns(const std::string & scfile) const;
 };
 
 st_app::StAppFactory<SourceInfo> myAppFactory("add_source_info");
@@ -75,7 +126,8 @@ std::string SourceInfo::s_cvs_id("$Name$");
 SourceInfo::SourceInfo() 
    : st_app::StApp(), 
      m_formatter(new st_stream::StreamFormatter("add_source_info", "", 2)),
-     m_pars(st_app::StApp::getParGroup("add_source_info")) {
+     m_pars(st_app::StApp::getParGroup("add_source_info")),
+     m_clobber(true), m_add_exposure(false), m_aeffTable(0) {
    setVersion(s_cvs_id);
 }
 
@@ -87,11 +139,33 @@ void SourceInfo::banner() const {
 }
 
 void SourceInfo::run() {
-   promptForParameters();
-   double ra = m_pars["ra"];
-   double dec = m_pars["dec"];
-   m_srcDir = astro::SkyDir(ra, dec);
-   addColumns();
+   std::string srclist = m_pars["srclist"];
+   if (srclist != "none" && srclist != "") {
+      m_pars.Prompt("scfile");
+      m_pars.Save();
+      readSourceList(srclist);
+   } else {
+      promptForParameters();
+      std::string srcName = m_pars["srcname"];
+      double ra = m_pars["ra"];
+      double dec = m_pars["dec"];
+      m_sources.push_back(Source(srcName, ra, dec));
+   }
+
+// Everything that does not depend on the FT2 file is set up once.
+   std::string sctable = m_pars["sctable"];
+   m_sctable = sctable;
+   m_clobber = m_pars["clobber"];
+   setUpAeff();
+
+   std::string scfile = m_pars["scfile"];
+   std::vector<std::string> scfiles;
+   st_facilities::Util::resolve_fits_files(scfile, scfiles);
+   if (scfiles.size() == 1) {
+      addColumns(scfiles.front());
+   } else {
+      processFiles(scfiles);
+   }
 }
 
 void SourceInfo::promptForParameters() {
@@ -99,58 +173,248 @@ void SourceInfo::promptForParameters() {
    m_pars.Save();
 }
 
+void SourceInfo::readSourceList(const std::string & srclist) {
+// Each entry is "srcname ra dec".
+   std::vector<std::string> lines;
+   st_facilities::Util::readLines(srclist, lines, "#", true);
+   for (size_t i(0); i < lines.size(); i++) {
+      std::vector<std::string> tokens;
+      facilities::Util::stringTokenize(lines[i], " \t", tokens);
+      if (tokens.size() != 3) {
+         throw std::runtime_error("add_source_info: invalid source list "
+                                  "entry: " + lines[i]);
+      }
+      m_sources.push_back(Source(tokens[0], std::atof(tokens[1].c_str()),
+                                 std::atof(tokens[2].c_str())));
+   }
+   if (m_sources.empty()) {
+      throw std::runtime_error("add_source_info: no sources in " + srclist);
+   }
+}
+
+void SourceInfo::setUpAeff() {
+// The effective area is tabulated once for all files, sources, and
+// rows.
+   std::string irfsName = m_pars["irfs"];
+   m_add_exposure = m_pars["exposure"];
+   if (irfsName == "none" || irfsName == "") {
+      if (m_add_exposure) {
+         throw std::runtime_error("add_source_info: exposure columns "
+                                  "require the effective area; set irfs.");
+      }
+      return;
+   }
+// Loader::go selects event classes, so drop any event type suffix,
+// e.g., "::FRONT"; the factory takes the full name.
+   irfLoader::Loader::go(irfsName.substr(0, irfsName.find("::")));
+   irfInterface::IrfsFactory & 
+      irfsFactory(*irfInterface::IrfsFactory::instance());
+   irfInterface::Irfs * irfs(irfsFactory.create(irfsName));
+   double energy = m_pars["energy"];
+   m_aeffTable = new fitsGenApps::AeffTable(*irfs->aeff(), energy);
+   delete irfs;
+}
+
+void SourceInfo::processFiles(const std::vector<std::string> & scfiles) const {
+   unsigned int nworkers = m_pars["nworkers"];
+   if (nworkers == 0) {
+      nworkers = std::max(std::thread::hardware_concurrency(), 1u);
+   }
+   size_t nfiles(scfiles.size());
+   std::vector<std::string> errors(nfiles);
+   if (nworkers == 1) {
+      for (size_t i(0); i < nfiles; i++) {
+         try {
+            addColumns(scfiles[i]);
+         } catch (std::exception & eObj) {
+            errors[i] = eObj.what();
+         }
+      }
+   } else {
+// Each file is processed in its own child process, since neither tip
+// nor cfitsio can be used from several threads.  A shared mapping
+// holds the error messages of the children.
+      void * addr(mmap(0, nfiles*message_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+      if (addr == MAP_FAILED) {
+         throw std::runtime_error("add_source_info: cannot map "
+                                  "shared memory.");
+      }
+      char * messages(static_cast<char *>(addr));
+      std::memset(messages, 0, nfiles*message_size);
+      std::map<pid_t, size_t> running;
+      size_t next(0);
+      while (next < nfiles || !running.empty()) {
+         if (next < nfiles && running.size() < nworkers) {
+            pid_t pid(fork());
+            if (pid == 0) {
+               int status(0);
+               try {
+                  addColumns(scfiles[next]);
+               } catch (std::exception & eObj) {
+                  std::strncpy(messages + next*message_size, eObj.what(),
+                               message_size - 1);
+                  status = 1;
+               } catch (...) {
+                  status = 1;
+               }
+// Leave without running destructors or flushing the parent's buffers.
+               _exit(status);
+            }
+            if (pid < 0) {
+               errors[next] = "cannot fork worker process";
+            } else {
+               running[pid] = next;
+            }
+            next++;
+            continue;
+         }
+         int status;
+         pid_t pid(waitpid(-1, &status, 0));
+         if (pid < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            break;
+         }
+         std::map<pid_t, size_t>::iterator child(running.find(pid));
+         if (child == running.end()) {
+            continue;
+         }
+         size_t i(child->second);
+         running.erase(child);
+         if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            errors[i] = messages[i*message_size] != 0 ?
+               std::string(messages + i*message_size) : "worker failed";
+         }
+      }
+// If waiting failed, a file is never reported as done without its
+// worker having confirmed it.
+      std::map<pid_t, size_t>::const_iterator child(running.begin());
+      for ( ; child != running.end(); ++child) {
+         errors[child->second] = "worker status unknown";
+      }
+      for ( ; next < nfiles; next++) {
+         errors[next] = "not processed";
+      }
+      munmap(addr, nfiles*message_size);
+   }
+
+   size_t nfailed(0);
+   for (size_t i(0); i < nfiles; i++) {
+      if (errors[i] == "") {
+         m_formatter->info() << scfiles[i] << ": done" << std::endl;
+      } else {
+         m_formatter->info() << scfiles[i] << ": FAILED: " << errors[i]
+                             << std::endl;
+         nfailed++;
+      }
+   }
+   m_formatter->info() << nfiles - nfailed << " of " << nfiles
+                       << " files processed" << std::endl;
+   if (nfailed > 0) {
+      std::ostringstream message;
+      message << "add_source_info: " << nfailed << " of " << nfiles 
+              << " files failed.";
+      throw std::runtime_error(message.str());
+   }
+}
+
 void SourceInfo::appendField(tip::Table * sctable, 
                              const std::string & fieldName) const {
    try {
       sctable->appendField(fieldName, "D");
    } catch (tip::TipException & eObj) {
-      bool clobber = m_pars["clobber"];
-      if (!clobber) {
+      if (!m_clobber) {
          throw;
       }
    }
 }
 
-void SourceInfo::addColumns() {
-//    irfLoader::Loader::go();
-//    irfInterface::IrfsFactory & 
-//       irfsFactory(*irfInterface::IrfsFactory::instance());
-
-//    irfInterface::Irfs * irfs(irfsFactory.create(m_pars["irfs"]));
+void SourceInfo::addColumns(const std::string & scfile) const {
+   bool add_aeff(m_aeffTable != 0);
+   bool add_exposure(add_aeff && m_add_exposure);
 
    tip::Table * sctable
-      = tip::IFileSvc::instance().editTable(m_pars["scfile"], 
-                                            m_pars["sctable"]);
-
-   tip::Table::Iterator it = sctable->begin();
-   tip::TableRecord & row = *it;
-
-   std::string srcName = m_pars["srcname"];
-   std::string thetaField(srcName + "_THETA");
-   std::string phiField(srcName + "_PHI");
-//   std::string aeffField(srcName + "_aeff");
-   appendField(sctable, thetaField);
-   appendField(sctable, phiField);
-//   appendField(sctable, aeffField);
-
-   double ra_scz, dec_scz, ra_scx, dec_scx;
-   for ( ; it != sctable->end(); ++it) {
-      row["ra_scz"].get(ra_scz);
-      row["dec_scz"].get(dec_scz);
-      row["ra_scx"].get(ra_scx);
-      row["dec_scx"].get(dec_scx);
-      astro::SkyDir zhat(ra_scz, dec_scz);
-      astro::SkyDir xhat(ra_scx, dec_scx);
-      astro::SkyDir yhat(-xhat.dir().cross(zhat.dir()));
-      double theta(std::acos(m_srcDir.dir().dot(zhat.dir()))*180./M_PI);
-      double phi(std::atan2(yhat.dir().dot(m_srcDir.dir()),
-                            xhat.dir().dot(m_srcDir.dir()))*180./M_PI);
-      if (phi < 0) {
-         phi += 360.;
-      }
-      row[thetaField].set(theta);
-      row[phiField].set(phi);
-//      row[aeffField].set(irfs->aeff()->value(m_pars["energy"], theta, phi));
+      = tip::IFileSvc::instance().editTable(scfile, m_sctable);
+
+   size_t nsrcs(m_sources.size());
+   std::vector<std::string> thetaFields, phiFields, aeffFields, expFields;
+   for (size_t k(0); k < nsrcs; k++) {
+      thetaFields.push_back(m_sources[k].name + "_THETA");
+      phiFields.push_back(m_sources[k].name + "_PHI");
+      aeffFields.push_back(m_sources[k].name + "_AEFF");
+      expFields.push_back(m_sources[k].name + "_EXPOSURE");
+      appendField(sctable, thetaFields[k]);
+      appendField(sctable, phiFields[k]);
+      if (add_aeff) {
+         appendField(sctable, aeffFields[k]);
+      }
+      if (add_exposure) {
+         appendField(sctable, expFields[k]);
+      }
    }
    delete sctable;
+
+// The columns are read and written as arrays, in blocks of rows: the
+// spacecraft frame for a block is computed once and used for all of
+// the sources.  Each block holds about 32 MB of column data.
+   fitsGenApps::ColumnTable table(scfile, m_sctable);
+   int ra_scz_col(table.columnNumber("ra_scz"));
+   int dec_scz_col(table.columnNumber("dec_scz"));
+   int ra_scx_col(table.columnNumber("ra_scx"));
+   int dec_scx_col(table.columnNumber("dec_scx"));
+   int livetime_col(add_exposure ? table.columnNumber("livetime") : 0);
+   std::vector<int> thetaCols, phiCols, aeffCols, expCols;
+   for (size_t k(0); k < nsrcs; k++) {
+      thetaCols.push_back(table.columnNumber(thetaFields[k]));
+      phiCols.push_back(table.columnNumber(phiFields[k]));
+      if (add_aeff) {
+         aeffCols.push_back(table.columnNumber(aeffFields[k]));
+      }
+      if (add_exposure) {
+         expCols.push_back(table.columnNumber(expFields[k]));
+      }
+   }
+   long ncols(4*nsrcs + 5);
+   long block_size(std::max(1000L, (1L << 22)/ncols));
+   std::vector<double> ra_scz, dec_scz, ra_scx, dec_scx, livetime;
+   fitsGenApps::UnitVectors zhat, xhat, yhat;
+   std::vector<double> theta, phi, aeff, exposure;
+   for (long first(0); first < table.nrows(); first += block_size) {
+      long nrows(std::min(block_size, table.nrows() - first));
+      table.read(ra_scz_col, first, nrows, ra_scz);
+      table.read(dec_scz_col, first, nrows, dec_scz);
+      table.read(ra_scx_col, first, nrows, ra_scx);
+      table.read(dec_scx_col, first, nrows, dec_scx);
+      if (add_exposure) {
+         table.read(livetime_col, first, nrows, livetime);
+      }
+
+      fitsGenApps::SkyGeometry::unitVectors(ra_scz, dec_scz, zhat);
+      fitsGenApps::SkyGeometry::unitVectors(ra_scx, dec_scx, xhat);
+      fitsGenApps::SkyGeometry::yAxes(zhat, xhat, yhat);
+      for (size_t k(0); k < nsrcs; k++) {
+         const Source & src(m_sources[k]);
+         fitsGenApps::SkyGeometry::thetaPhi(zhat, xhat, yhat, src.x, src.y,
+                                            src.z, theta, phi);
+         table.write(thetaCols[k], first, theta);
+         table.write(phiCols[k], first, phi);
+         if (add_aeff) {
+            m_aeffTable->values(theta, phi, aeff);
+            table.write(aeffCols[k], first, aeff);
+         }
+         if (add_exposure) {
+            exposure.resize(aeff.size());
+            for (size_t i(0); i < aeff.size(); i++) {
+               exposure[i] = aeff[i]*livetime[i];
+            }
+            table.write(expCols[k], first, exposure);
+         }
+      }
+   }
+   table.close();
+// The columns were written with cfitsio directly, bypassing tip, so
+// the checksums are not yet up to date.
+   st_facilities::FitsUtil::writeChecksums(scfile);
 }
@@ -0,0 +1,200 @@
+/**
+ * @file Ft2Appender.cxx
+ * @brief Extend an existing FT2 file with newer rows.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "fitsio.h"
+
+#include "tip/Extension.h"
+#include "tip/Header.h"
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
+
+#include "st_facilities/FitsUtil.h"
+
+#include "Ft2Appender.h"
+
+namespace {
+/// Ones' complement addition of 32-bit words is addition modulo
+/// 2^32 - 1.
+   const unsigned long long modulus(0xffffffffULL);
+
+   void checkStatus(int status, const std::string & message) {
+      if (status != 0) {
+         char text[FLEN_STATUS];
+         fits_get_errstatus(status, text);
+         throw std::runtime_error("Ft2Appender: " + message + ": " + text);
+      }
+   }
+
+/// Contribution of rows [first, first + nrows) of the current table
+/// to its DATASUM, i.e., the sum modulo 2^32 - 1 of the big-endian
+/// 32-bit words of the data unit restricted to the bytes of those
+/// rows.
+   unsigned long long rowSum(fitsfile * fptr, long rowlen,
+                             long first, long nrows) {
+      const long chunk(std::max(1L, (1L << 22)/std::max(rowlen, 1L)));
+      std::vector<unsigned char> bytes;
+// Byte sums by position within the 32-bit words
+      unsigned long long lanes[4] = {0, 0, 0, 0};
+      for (long row(first); row < first + nrows; row += chunk) {
+         long n(std::min(chunk, first + nrows - row));
+         bytes.resize(n*rowlen);
+         int status(0);
+         fits_read_tblbytes(fptr, row + 1, 1, bytes.size(), &bytes[0],
+                            &status);
+         checkStatus(status, "reading SC_DATA rows");
+         long long offset(static_cast<long long>(row)*rowlen);
+         for (size_t i(0); i < bytes.size(); i++) {
+            lanes[(offset + i) % 4] += bytes[i];
+         }
+      }
+      unsigned long long sum(0);
+      for (int k(0); k < 4; k++) {
+         sum = (sum + ((lanes[k] % modulus) << 8*(3 - k)) % modulus) % modulus;
+      }
+      return sum;
+   }
+
+/// Open the SC_DATA table and read its row length and DATASUM.
+/// @return false if the DATASUM cannot be updated incrementally,
+/// i.e., it is absent or the table has a heap.
+   bool openDataSum(const std::string & file, int mode, fitsfile *& fptr,
+                    long & rowlen, unsigned long long & datasum) {
+      int status(0);
+      fits_open_file(&fptr, file.c_str(), mode, &status);
+      checkStatus(status, "opening " + file);
+      char extname[] = "SC_DATA";
+      fits_movnam_hdu(fptr, BINARY_TBL, extname, 0, &status);
+      long pcount(0);
+      fits_read_key(fptr, TLONG, "NAXIS1", &rowlen, 0, &status);
+      fits_read_key(fptr, TLONG, "PCOUNT", &pcount, 0, &status);
+      checkStatus(status, "reading SC_DATA header of " + file);
+      char value[FLEN_VALUE];
+      fits_read_key(fptr, TSTRING, "DATASUM", value, 0, &status);
+      if (status == KEY_NO_EXIST || pcount > 0) {
+         status = 0;
+         fits_close_file(fptr, &status);
+         return false;
+      }
+      checkStatus(status, "reading DATASUM of " + file);
+      datasum = std::strtoull(value, 0, 10) % modulus;
+      return true;
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+Ft2Appender::Ft2Appender(const std::string & ft2File)
+   : m_ft2_file(ft2File), m_scratch_file(ft2File + ".append"),
+     m_stop_time(0), m_nrows(0) {
+   const tip::Table * table
+      = tip::IFileSvc::instance().readTable(m_ft2_file, "SC_DATA");
+   m_nrows = table->getNumRecords();
+   if (m_nrows > 0) {
+      tip::Table::ConstIterator it(table->end());
+      --it;
+      m_stop_time = (*it)["stop"].get();
+   }
+   delete table;
+}
+
+Ft2Appender::~Ft2Appender() throw() {
+   std::remove(m_scratch_file.c_str());
+}
+
+long Ft2Appender::append(long nreplace) {
+   const tip::Table * source
+      = tip::IFileSvc::instance().readTable(m_scratch_file, "SC_DATA");
+   tip::Table * target
+      = tip::IFileSvc::instance().editTable(m_ft2_file, "SC_DATA");
+   nreplace = std::min(nreplace, m_nrows);
+   tip::Index_t first(m_nrows - nreplace);
+   tip::Index_t nsource(source->getNumRecords());
+   if (nsource == 0) {
+      delete source;
+      delete target;
+      return 0;
+   }
+// The DATASUM of SC_DATA is updated for the replaced and added rows
+// only, so that the rows already in the file are not read again.
+   fitsfile * fptr(0);
+   long rowlen(0);
+   unsigned long long datasum(0);
+   bool incremental(openDataSum(m_ft2_file, READONLY, fptr, rowlen, datasum));
+   if (incremental) {
+      datasum = (datasum + modulus 
+                 - rowSum(fptr, rowlen, first, nreplace)) % modulus;
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkStatus(status, "closing " + m_ft2_file);
+   }
+   target->setNumRecords(first + nsource);
+   tip::Table::Iterator out(target->begin());
+   for (tip::Index_t i(0); i < first; i++) {
+      ++out;
+   }
+   tip::Table::ConstIterator in(source->begin());
+   for ( ; in != source->end(); ++in, ++out) {
+      *out = *in;
+      m_stop_time = (*in)["stop"].get();
+   }
+   double tstart((*target->begin())["start"].get());
+   delete source;
+   delete target;
+   m_nrows = first + nsource;
+
+   const char * extnames[] = {"", "SC_DATA"};
+   for (size_t i(0); i < 2; i++) {
+      tip::Extension * hdu
+         = tip::IFileSvc::instance().editExtension(m_ft2_file, extnames[i]);
+      hdu->getHeader()["TSTART"].set(tstart);
+      hdu->getHeader()["TSTOP"].set(m_stop_time);
+      delete hdu;
+   }
+   if (incremental) {
+      updateChecksums(datasum, first, nsource);
+   } else {
+      st_facilities::FitsUtil::writeChecksums(m_ft2_file);
+   }
+   return nsource - nreplace;
+}
+
+void Ft2Appender::updateChecksums(unsigned long long datasum, 
+                                  long first, long nrows) const {
+   fitsfile * fptr(0);
+   long rowlen(0);
+   unsigned long long unused;
+   openDataSum(m_ft2_file, READWRITE, fptr, rowlen, unused);
+   datasum = (datasum + rowSum(fptr, rowlen, first, nrows)) % modulus;
+// A nonzero sum of words in ones' complement arithmetic is never
+// +0, so a multiple of 2^32 - 1 is written as -0.
+   if (datasum == 0 && first + nrows > 0) {
+      datasum = modulus;
+   }
+   char value[FLEN_VALUE];
+   std::sprintf(value, "%llu", datasum);
+   int status(0);
+   fits_update_key(fptr, TSTRING, "DATASUM", value, "data unit checksum",
+                   &status);
+// Only the headers are summed for the CHECKSUMs, using the DATASUMs.
+   fits_update_chksum(fptr, &status);
+   fits_movabs_hdu(fptr, 1, 0, &status);
+   fits_write_chksum(fptr, &status);
+   fits_close_file(fptr, &status);
+   checkStatus(status, "updating checksums of " + m_ft2_file);
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,74 @@
+/**
+ * @file Ft2Appender.h
+ * @brief Extend an existing FT2 file with newer rows.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_Ft2Appender_h
+#define fitsGenApps_Ft2Appender_h
+
+#include <string>
+
+namespace fitsGenApps {
+
+/**
+ * @class Ft2Appender
+ * @brief The new rows are written with fitsGen::Ft2File, as for a new
+ * file, to a scratch file alongside the existing one.  append() then
+ * copies them to the end of the existing SC_DATA table, optionally
+ * replacing its last rows, e.g., a final row whose derived columns
+ * have been recomputed now that the following row is known.
+ */
+
+class Ft2Appender {
+
+public:
+
+   Ft2Appender(const std::string & ft2File);
+
+   /// Removes the scratch file.
+   ~Ft2Appender() throw();
+
+   /// STOP of the last row of the existing file.  Only rows starting
+   /// at or after this time should be appended.
+   double stopTime() const {
+      return m_stop_time;
+   }
+
+   /// Number of rows in the existing file.
+   long nrows() const {
+      return m_nrows;
+   }
+
+   /// File in which to write the new rows.
+   const std::string & scratchFile() const {
+      return m_scratch_file;
+   }
+
+   /// Copy the rows of the scratch file to the existing file,
+   /// overwriting its last nreplace rows, and update TSTART, TSTOP,
+   /// and the checksums.  The DATASUM of SC_DATA is updated from the
+   /// replaced and added rows alone.
+   /// @return The number of rows added.
+   long append(long nreplace=0);
+
+private:
+
+   std::string m_ft2_file;
+   std::string m_scratch_file;
+   double m_stop_time;
+   long m_nrows;
+
+   /// Add the rows [first, first + nrows) of SC_DATA to datasum, the
+   /// sum over the other rows, and write it and the CHECKSUMs.
+   void updateChecksums(unsigned long long datasum, 
+                        long first, long nrows) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_Ft2Appender_h
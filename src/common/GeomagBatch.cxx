@@ -0,0 +1,301 @@
+/**
+ * @file GeomagBatch.cxx
+ * @brief Evaluate astro::EarthCoordinate quantities for many
+ * spacecraft positions at once.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CLHEP/Vector/ThreeVector.h"
+
+#include "astro/EarthCoordinate.h"
+
+#include "GeomagBatch.h"
+#include "GeomagGrid.h"
+
+namespace {
+/// Rows per worker below which forking is not worth its cost.
+   const size_t min_rows(10000);
+
+/// Space for each worker's error message.
+   const size_t message_size(256);
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+GeomagBatch::GeomagBatch(unsigned int nworkers, bool mcilwain)
+   : m_nworkers(nworkers), m_mcilwain(mcilwain), m_useGrid(false),
+     m_tolerance(0), m_nsamples(0), m_grid(nworkers), m_gridUsed(false),
+     m_gridFromCache(false), m_nrows(0), m_nboundary(0), m_nsampled(0),
+     m_nmismatched(0), m_nfallback(0), m_nskipped(0), m_max_deviation(0) {
+   if (m_nworkers == 0) {
+      m_nworkers = std::max(std::thread::hardware_concurrency(), 1u);
+   }
+}
+
+void GeomagBatch::useGrid(const std::string & cachefile, double tolerance,
+                          size_t nsamples) {
+   m_useGrid = true;
+   m_gridCache = cachefile;
+   m_tolerance = tolerance;
+   m_nsamples = nsamples;
+}
+
+void GeomagBatch::compute(const std::vector<float> & sc_x,
+                          const std::vector<float> & sc_y,
+                          const std::vector<float> & sc_z,
+                          const std::vector<double> & met) {
+   size_t nrows(met.size());
+   if (sc_x.size() != nrows || sc_y.size() != nrows || sc_z.size() != nrows) {
+      throw std::runtime_error("GeomagBatch::compute: position and time "
+                               "columns differ in length.");
+   }
+   if (m_useGrid && !m_mcilwain && nrows > 0) {
+      computeFromGrid(sc_x, sc_y, sc_z, met);
+   } else {
+      computeExact(sc_x, sc_y, sc_z, met);
+   }
+}
+
+void GeomagBatch::computeExact(const std::vector<float> & sc_x,
+                               const std::vector<float> & sc_y,
+                               const std::vector<float> & sc_z,
+                               const std::vector<double> & met) {
+   size_t nrows(met.size());
+   size_t nworkers(std::min(static_cast<size_t>(m_nworkers),
+                            nrows/min_rows));
+   if (nworkers > 1) {
+      computeInWorkers(sc_x, sc_y, sc_z, met, nworkers);
+      return;
+   }
+   m_geolat.resize(nrows);
+   m_in_saa.resize(nrows);
+   m_l_mcilwain.resize(m_mcilwain ? nrows : 0);
+   m_b_mcilwain.resize(m_mcilwain ? nrows : 0);
+   if (nrows == 0) {
+      return;
+   }
+   Columns columns;
+   columns.geolat = &m_geolat[0];
+   columns.in_saa = &m_in_saa[0];
+   columns.l_mcilwain = m_mcilwain ? &m_l_mcilwain[0] : 0;
+   columns.b_mcilwain = m_mcilwain ? &m_b_mcilwain[0] : 0;
+   computeRows(sc_x, sc_y, sc_z, met, 0, nrows, columns);
+}
+
+void GeomagBatch::computeFromGrid(const std::vector<float> & sc_x,
+                                  const std::vector<float> & sc_y,
+                                  const std::vector<float> & sc_z,
+                                  const std::vector<double> & met) {
+   size_t nrows(met.size());
+   m_gridUsed = true;
+   if (!m_grid.prepare(sc_x, sc_y, sc_z, met, m_gridCache)) {
+      m_nskipped += nrows;
+      computeExact(sc_x, sc_y, sc_z, met);
+      return;
+   }
+   m_gridFromCache = m_gridFromCache || m_grid.fromCache();
+
+   m_geolat.resize(nrows);
+   m_in_saa.resize(nrows);
+   m_l_mcilwain.clear();
+   m_b_mcilwain.clear();
+
+// Rows to be evaluated exactly: those on the SAA boundary, and every
+// stride-th row as the validation sample.
+   size_t stride(std::max(nrows/std::max(m_nsamples, size_t(1)), size_t(1)));
+   std::vector<size_t> rows;
+   std::vector<char> boundary(nrows, 0);
+   size_t nboundary(0);
+   for (size_t i(0); i < nrows; i++) {
+      bool in_saa;
+      if (m_grid.lookup(sc_x[i], sc_y[i], sc_z[i], met[i], m_geolat[i], 
+                      in_saa)) {
+         m_in_saa[i] = in_saa;
+      } else {
+         boundary[i] = 1;
+         nboundary++;
+      }
+      if (boundary[i] || i % stride == 0) {
+         rows.push_back(i);
+      }
+   }
+   std::vector<float> x(rows.size()), y(rows.size()), z(rows.size());
+   std::vector<double> t(rows.size());
+   for (size_t k(0); k < rows.size(); k++) {
+      x[k] = sc_x[rows[k]];
+      y[k] = sc_y[rows[k]];
+      z[k] = sc_z[rows[k]];
+      t[k] = met[rows[k]];
+   }
+   GeomagBatch exact(m_nworkers);
+   exact.computeExact(x, y, z, t);
+
+   double max_deviation(0);
+   size_t nsampled(0), nmismatched(0);
+   for (size_t k(0); k < rows.size(); k++) {
+      size_t i(rows[k]);
+      if (!boundary[i]) {
+         nsampled++;
+         max_deviation = std::max(max_deviation, 
+                                  std::fabs(m_geolat[i] - exact.geolat()[k]));
+         if (m_in_saa[i] != exact.in_saa()[k]) {
+            nmismatched++;
+         }
+      }
+      m_geolat[i] = exact.geolat()[k];
+      m_in_saa[i] = exact.in_saa()[k];
+   }
+
+   m_nrows += nrows;
+   m_nboundary += nboundary;
+   m_nsampled += nsampled;
+   m_nmismatched += nmismatched;
+   m_max_deviation = std::max(m_max_deviation, max_deviation);
+   if (max_deviation > m_tolerance || nmismatched > 0) {
+      m_nfallback += nrows;
+      computeExact(sc_x, sc_y, sc_z, met);
+   }
+}
+
+std::string GeomagBatch::gridReport() const {
+   if (!m_gridUsed) {
+      return "";
+   }
+   std::ostringstream report;
+   report << "Geomagnetic grid: " << m_grid.nnodes() << " nodes"
+          << (m_gridFromCache ? " read from " + m_gridCache : "") << "\n"
+          << "Rows evaluated exactly on the SAA boundary: " 
+          << m_nboundary << " of " << m_nrows << "\n"
+          << "Maximum geomagnetic latitude deviation in " << m_nsampled 
+          << " sampled rows: " << m_max_deviation << " deg\n"
+          << "SAA flag mismatches in sampled rows: " << m_nmismatched;
+   if (m_nskipped > 0) {
+      report << "\nRows evaluated exactly because extending the grid "
+             << "would cost more: " << m_nskipped;
+   }
+   if (m_nfallback > 0) {
+      report << "\nTolerance of " << m_tolerance 
+             << " deg exceeded; " << m_nfallback 
+             << " rows evaluated exactly";
+   }
+   return report.str();
+}
+
+void GeomagBatch::computeRows(const std::vector<float> & sc_x,
+                              const std::vector<float> & sc_y,
+                              const std::vector<float> & sc_z,
+                              const std::vector<double> & met,
+                              size_t first, size_t last,
+                              const Columns & columns) const {
+   for (size_t i(first); i < last; i++) {
+// EarthCoordinate takes the position in km.
+      CLHEP::Hep3Vector pos(sc_x[i]/1e3, sc_y[i]/1e3, sc_z[i]/1e3);
+      astro::EarthCoordinate coord(pos, met[i]);
+      columns.geolat[i] = coord.geolat();
+      columns.in_saa[i] = coord.insideSAA();
+      if (m_mcilwain) {
+         columns.l_mcilwain[i] = coord.L();
+         columns.b_mcilwain[i] = coord.B();
+      }
+   }
+}
+
+void GeomagBatch::computeInWorkers(const std::vector<float> & sc_x,
+                                   const std::vector<float> & sc_y,
+                                   const std::vector<float> & sc_z,
+                                   const std::vector<double> & met,
+                                   size_t nworkers) {
+   size_t nrows(met.size());
+// One anonymous shared mapping holds the output columns, followed by
+// the error message slots of the workers.
+   size_t size(3*nrows*sizeof(double) + nrows + nworkers*message_size);
+   void * addr(mmap(0, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+   if (addr == MAP_FAILED) {
+      throw std::runtime_error("GeomagBatch: cannot map shared memory.");
+   }
+   Columns columns;
+   columns.geolat = static_cast<double *>(addr);
+   columns.l_mcilwain = columns.geolat + nrows;
+   columns.b_mcilwain = columns.l_mcilwain + nrows;
+   columns.in_saa = reinterpret_cast<char *>(columns.b_mcilwain + nrows);
+   char * messages(columns.in_saa + nrows);
+   std::memset(messages, 0, nworkers*message_size);
+
+   std::vector<pid_t> pids;
+   for (size_t k(0); k < nworkers; k++) {
+      size_t first(k*nrows/nworkers);
+      size_t last((k + 1)*nrows/nworkers);
+      pid_t pid(fork());
+      if (pid == 0) {
+         int status(0);
+         try {
+            computeRows(sc_x, sc_y, sc_z, met, first, last, columns);
+         } catch (std::exception & eObj) {
+            std::strncpy(messages + k*message_size, eObj.what(),
+                         message_size - 1);
+            status = 1;
+         } catch (...) {
+            status = 1;
+         }
+// Leave without running destructors or flushing the parent's buffers.
+         _exit(status);
+      }
+      if (pid < 0) {
+         break;
+      }
+      pids.push_back(pid);
+   }
+
+   std::string error;
+   if (pids.size() < nworkers) {
+      error = "GeomagBatch: cannot fork worker process.";
+   }
+   for (size_t k(0); k < pids.size(); k++) {
+      int status;
+      if (waitpid(pids[k], &status, 0) < 0
+          || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+         if (error == "") {
+            std::ostringstream message;
+            message << "GeomagBatch: worker " << k << " failed";
+            if (messages[k*message_size] != 0) {
+               message << ": " << messages + k*message_size;
+            }
+            error = message.str();
+         }
+      }
+   }
+   if (error == "") {
+      m_geolat.assign(columns.geolat, columns.geolat + nrows);
+      m_in_saa.assign(columns.in_saa, columns.in_saa + nrows);
+      if (m_mcilwain) {
+         m_l_mcilwain.assign(columns.l_mcilwain, columns.l_mcilwain + nrows);
+         m_b_mcilwain.assign(columns.b_mcilwain, columns.b_mcilwain + nrows);
+      } else {
+         m_l_mcilwain.clear();
+         m_b_mcilwain.clear();
+      }
+   }
+   munmap(addr, size);
+   if (error != "") {
+      throw std::runtime_error(error);
+   }
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,152 @@
+/**
+ * @file GeomagBatch.h
+ * @brief Evaluate astro::EarthCoordinate quantities for many
+ * spacecraft positions at once.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_GeomagBatch_h
+#define fitsGenApps_GeomagBatch_h
+
+#include <string>
+#include <vector>
+
+#include "GeomagGrid.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class GeomagBatch
+ * @brief Build a single astro::EarthCoordinate per row and extract
+ * the geomagnetic latitude, SAA flag and, optionally, the McIlwain L
+ * and B parameters from it.
+ *
+ * EarthCoordinate evaluates the field model through shared static
+ * state, so it cannot be used on several threads.  The rows are
+ * instead divided among forked worker processes that write their
+ * results to shared memory.
+ *
+ * Optionally, the geomagnetic latitude and SAA flag are looked up in
+ * a GeomagGrid instead.  Rows in grid cells on the SAA boundary, and
+ * a sample of the other rows, are still evaluated exactly; if the
+ * sample deviates from the grid by more than a tolerance, all rows
+ * are evaluated exactly.  The grid is kept between calls to
+ * compute(), so that a long input can be processed in blocks.  A
+ * block is evaluated exactly if the grid does not cover it and
+ * extending the grid would take more evaluations than the block has
+ * rows.
+ */
+
+class GeomagBatch {
+
+public:
+
+   /// @param nworkers Number of worker processes; zero means one per
+   ///        hardware thread.
+   /// @param mcilwain If true, also compute the McIlwain L and B.
+   GeomagBatch(unsigned int nworkers=1, bool mcilwain=false);
+
+   /// Use a GeomagGrid, read from or written to cachefile, unless
+   /// the McIlwain parameters are requested.
+   /// @param tolerance Largest acceptable deviation (degrees) of the
+   ///        interpolated geomagnetic latitude in the validation
+   ///        sample.
+   /// @param nsamples Number of rows in the validation sample.
+   void useGrid(const std::string & cachefile, double tolerance,
+                size_t nsamples=1000);
+
+   /// @param sc_x, sc_y, sc_z Spacecraft positions in meters.
+   /// @param met Mission elapsed time at which to evaluate each row.
+   void compute(const std::vector<float> & sc_x,
+                const std::vector<float> & sc_y,
+                const std::vector<float> & sc_z,
+                const std::vector<double> & met);
+
+   const std::vector<double> & geolat() const {
+      return m_geolat;
+   }
+
+   /// SAA flags; char rather than bool so that rows can be written
+   /// independently.
+   const std::vector<char> & in_saa() const {
+      return m_in_saa;
+   }
+
+   const std::vector<double> & l_mcilwain() const {
+      return m_l_mcilwain;
+   }
+
+   const std::vector<double> & b_mcilwain() const {
+      return m_b_mcilwain;
+   }
+
+   /// Summary of the grid lookups and their validation over all
+   /// calls to compute(), or an empty string if the grid was not used.
+   std::string gridReport() const;
+
+private:
+
+   unsigned int m_nworkers;
+   bool m_mcilwain;
+
+   bool m_useGrid;
+   std::string m_gridCache;
+   double m_tolerance;
+   size_t m_nsamples;
+
+   GeomagGrid m_grid;
+   bool m_gridUsed;
+   bool m_gridFromCache;
+
+/// Grid validation tallies, accumulated over calls to compute()
+   size_t m_nrows;
+   size_t m_nboundary;
+   size_t m_nsampled;
+   size_t m_nmismatched;
+   size_t m_nfallback;
+   size_t m_nskipped;
+   double m_max_deviation;
+
+   std::vector<double> m_geolat;
+   std::vector<char> m_in_saa;
+   std::vector<double> m_l_mcilwain;
+   std::vector<double> m_b_mcilwain;
+
+   /// Output columns for a block of rows.
+   struct Columns {
+      double * geolat;
+      char * in_saa;
+      double * l_mcilwain;
+      double * b_mcilwain;
+   };
+
+   void computeExact(const std::vector<float> & sc_x,
+                     const std::vector<float> & sc_y,
+                     const std::vector<float> & sc_z,
+                     const std::vector<double> & met);
+
+   void computeFromGrid(const std::vector<float> & sc_x,
+                        const std::vector<float> & sc_y,
+                        const std::vector<float> & sc_z,
+                        const std::vector<double> & met);
+
+   void computeRows(const std::vector<float> & sc_x,
+                    const std::vector<float> & sc_y,
+                    const std::vector<float> & sc_z,
+                    const std::vector<double> & met,
+                    size_t first, size_t last, const Columns & columns) const;
+
+   void computeInWorkers(const std::vector<float> & sc_x,
+                         const std::vector<float> & sc_y,
+                         const std::vector<float> & sc_z,
+                         const std::vector<double> & met,
+                         size_t nworkers);
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_GeomagBatch_h
@@ -0,0 +1,403 @@
+/**
+ * @file GeomagGrid.cxx
+ * @brief Lookup grids of geomagnetic latitude and SAA membership for
+ * the orbital shell covered by a set of spacecraft positions.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "astro/JulianDate.h"
+
+#include "fitsGen/FtFileBase.h"
+
+#include "st_stream/StreamFormatter.h"
+
+#include "GeomagBatch.h"
+#include "GeomagGrid.h"
+
+namespace {
+/// Node spacing in geocentric latitude (deg), longitude (deg),
+/// radius (km) and epoch (s).
+   const double lat_step(0.5);
+   const double lon_step(1.);
+   const double rad_step(20.);
+   const double epoch_step(365.25*86400.);
+
+   const std::string cache_version("GeomagGrid-1");
+
+   const double deg(M_PI/180.);
+
+/// First and last lattice indices bracketing the range [xmin, xmax],
+/// with at least two nodes.
+   void nodeRange(double xmin, double xmax, double step,
+                  long & imin, long & imax) {
+      imin = static_cast<long>(std::floor(xmin/step));
+      imax = static_cast<long>(std::ceil(xmax/step));
+      if (imax <= imin) {
+         imax = imin + 1;
+      }
+   }
+
+/// Combine the SAA flags of nodes that share a latitude and
+/// longitude: 2 if they differ, and -1 for none yet.
+   void combineSaa(int & flag, int node_flag) {
+      if (flag == -1) {
+         flag = node_flag;
+      } else if (flag != node_flag) {
+         flag = 2;
+      }
+   }
+
+/// Lower node and interpolation weight of x along an axis of n nodes
+/// starting at lattice index imin.
+   void locate(double x, double step, long imin, long n,
+               long & i, double & t) {
+      double u(x/step - imin);
+      i = std::min(std::max(static_cast<long>(std::floor(u)), 0L), n - 2);
+      t = std::min(std::max(u - i, 0.), 1.);
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+GeomagGrid::GeomagGrid(unsigned int nworkers)
+   : m_nworkers(nworkers), m_fromCache(false),
+     m_lat_min(0), m_nlat(0), m_rad_min(0), m_nrad(0),
+     m_epoch_min(0), m_nepoch(0) {}
+
+bool GeomagGrid::prepare(const std::vector<float> & sc_x,
+                         const std::vector<float> & sc_y,
+                         const std::vector<float> & sc_z,
+                         const std::vector<double> & met,
+                         const std::string & cachefile) {
+   m_fromCache = false;
+   if (met.empty()) {
+      return true;
+   }
+   Coords first(coords(sc_x[0], sc_y[0], sc_z[0], met[0]));
+   double lat_lo(first.lat), lat_hi(first.lat);
+   double rad_lo(first.radius), rad_hi(first.radius);
+   double met_lo(met[0]), met_hi(met[0]);
+   for (size_t i(1); i < met.size(); i++) {
+      Coords row(coords(sc_x[i], sc_y[i], sc_z[i], met[i]));
+      lat_lo = std::min(lat_lo, row.lat);
+      lat_hi = std::max(lat_hi, row.lat);
+      rad_lo = std::min(rad_lo, row.radius);
+      rad_hi = std::max(rad_hi, row.radius);
+      met_lo = std::min(met_lo, met[i]);
+      met_hi = std::max(met_hi, met[i]);
+   }
+   long lat_min, lat_max, rad_min, rad_max, epoch_min, epoch_max;
+   nodeRange(lat_lo, lat_hi, lat_step, lat_min, lat_max);
+   nodeRange(rad_lo, rad_hi, rad_step, rad_min, rad_max);
+   nodeRange(met_lo, met_hi, epoch_step, epoch_min, epoch_max);
+
+   if (!m_geolat.empty() 
+       && covers(lat_min, lat_max, rad_min, rad_max, epoch_min, epoch_max)) {
+      return true;
+   }
+   bool use_cache(cachefile != "" && cachefile != "none");
+   std::vector<const GeomagGrid *> known;
+   GeomagGrid cached(m_nworkers);
+   if (use_cache && cached.read(cachefile)) {
+      if (cached.covers(lat_min, lat_max, rad_min, rad_max, 
+                        epoch_min, epoch_max)) {
+         *this = cached;
+         m_fromCache = true;
+         return true;
+      }
+      known.push_back(&cached);
+   }
+   if (!m_geolat.empty()) {
+      known.push_back(this);
+   }
+// The lattice ranges of the merged grid are contiguous, so a grid
+// for rows far from the known ones includes the nodes between them.
+   GeomagGrid grid(m_nworkers);
+   grid.m_lat_min = lat_min;
+   grid.m_nlat = lat_max - lat_min + 1;
+   grid.m_rad_min = rad_min;
+   grid.m_nrad = rad_max - rad_min + 1;
+   grid.m_epoch_min = epoch_min;
+   grid.m_nepoch = epoch_max - epoch_min + 1;
+   for (size_t k(0); k < known.size(); k++) {
+      grid.include(*known[k]);
+   }
+   if (!grid.build(known, met.size())) {
+      return false;
+   }
+   *this = grid;
+// The cache is only an optimization, so the grid is used even if it
+// cannot be saved.
+   if (use_cache && !write(cachefile)) {
+      st_stream::StreamFormatter formatter("GeomagGrid", "prepare", 2);
+      formatter.warn() << "Cannot write geomagnetic grid cache " 
+                       << cachefile << "; continuing without it." 
+                       << std::endl;
+   }
+   return true;
+}
+
+bool GeomagGrid::lookup(float sc_x, float sc_y, float sc_z, double met,
+                        double & geolat, bool & in_saa) const {
+   Coords row(coords(sc_x, sc_y, sc_z, met));
+   long ilat, irad, iepoch;
+   double tlat, trad, tepoch;
+   locate(row.lat, lat_step, m_lat_min, m_nlat, ilat, tlat);
+   locate(row.radius, rad_step, m_rad_min, m_nrad, irad, trad);
+   locate(met, epoch_step, m_epoch_min, m_nepoch, iepoch, tepoch);
+   long ilon(static_cast<long>(std::floor(row.lon/lon_step)) % nlon());
+   double tlon(row.lon/lon_step - std::floor(row.lon/lon_step));
+   long ilon1((ilon + 1) % nlon());
+
+   geolat = 0;
+   for (long l(0); l < 2; l++) {
+      double wepoch(l ? tepoch : 1. - tepoch);
+      for (long k(0); k < 2; k++) {
+         double wrad(k ? trad : 1. - trad);
+         for (long i(0); i < 2; i++) {
+            double wlat(i ? tlat : 1. - tlat);
+            double w(wepoch*wrad*wlat);
+            geolat += w*((1. - tlon)*m_geolat[index(ilat + i, ilon,
+                                                    irad + k, iepoch + l)]
+                         + tlon*m_geolat[index(ilat + i, ilon1,
+                                               irad + k, iepoch + l)]);
+         }
+      }
+   }
+
+// The flag is taken from the nodes of the cell and of its neighbours,
+// so that a vertex of the SAA polygon poking into a cell whose own
+// corners agree is still found next to the boundary cells around it.
+   char flag(m_saa[ilat*nlon() + ilon]);
+   for (long i(std::max(ilat - 1, 0L)); i <= std::min(ilat + 2, m_nlat - 1);
+        i++) {
+      for (long j(-1); j <= 2; j++) {
+         if (m_saa[i*nlon() + (ilon + j + nlon()) % nlon()] != flag) {
+            return false;
+         }
+      }
+   }
+   if (flag == 2) {
+      return false;
+   }
+   in_saa = (flag == 1);
+   return true;
+}
+
+GeomagGrid::Coords GeomagGrid::coords(float sc_x, float sc_y, float sc_z,
+                                      double met) {
+   double x(sc_x/1e3), y(sc_y/1e3), z(sc_z/1e3);
+   Coords result;
+   result.radius = std::sqrt(x*x + y*y + z*z);
+   result.lat = std::asin(z/result.radius)/deg;
+   result.lon = std::fmod(std::atan2(y, x)/deg - gmst(met), 360.);
+   if (result.lon < 0) {
+      result.lon += 360.;
+   }
+   return result;
+}
+
+double GeomagGrid::gmst(double met) {
+   static double j2000_offset((astro::JulianDate(2451545.)
+                               - fitsGen::FtFileBase::missionStart()));
+   double days(met/astro::JulianDate::secondsPerDay - j2000_offset);
+   double centuries(days/36525.);
+   double gmst(280.46061837 + 360.98564736629*days
+               + centuries*centuries*(0.000387933 - centuries/38710000.));
+   gmst = std::fmod(gmst, 360.);
+   return gmst < 0 ? gmst + 360. : gmst;
+}
+
+long GeomagGrid::nlon() {
+   return static_cast<long>(360./lon_step + 0.5);
+}
+
+bool GeomagGrid::covers(long lat_min, long lat_max, long rad_min,
+                        long rad_max, long epoch_min, long epoch_max) const {
+   return (m_lat_min <= lat_min && lat_max < m_lat_min + m_nlat
+           && m_rad_min <= rad_min && rad_max < m_rad_min + m_nrad
+           && m_epoch_min <= epoch_min && epoch_max < m_epoch_min + m_nepoch);
+}
+
+void GeomagGrid::include(const GeomagGrid & other) {
+   long lat_max(std::max(m_lat_min + m_nlat, other.m_lat_min + other.m_nlat));
+   long rad_max(std::max(m_rad_min + m_nrad, other.m_rad_min + other.m_nrad));
+   long epoch_max(std::max(m_epoch_min + m_nepoch,
+                           other.m_epoch_min + other.m_nepoch));
+   m_lat_min = std::min(m_lat_min, other.m_lat_min);
+   m_rad_min = std::min(m_rad_min, other.m_rad_min);
+   m_epoch_min = std::min(m_epoch_min, other.m_epoch_min);
+   m_nlat = lat_max - m_lat_min;
+   m_nrad = rad_max - m_rad_min;
+   m_nepoch = epoch_max - m_epoch_min;
+}
+
+bool GeomagGrid::node(long lat, long ilon, long rad, long epoch,
+                      double & geolat) const {
+   lat -= m_lat_min;
+   rad -= m_rad_min;
+   epoch -= m_epoch_min;
+   if (m_geolat.empty() || lat < 0 || lat >= m_nlat || rad < 0 
+       || rad >= m_nrad || epoch < 0 || epoch >= m_nepoch) {
+      return false;
+   }
+   geolat = m_geolat[index(lat, ilon, rad, epoch)];
+   return true;
+}
+
+bool GeomagGrid::build(const std::vector<const GeomagGrid *> & known,
+                       size_t max_missing) {
+   size_t nnodes(m_nepoch*m_nrad*m_nlat*nlon());
+   std::vector<double> geolat(nnodes);
+   std::vector<size_t> missing;
+   for (long l(0); l < m_nepoch; l++) {
+      for (long k(0); k < m_nrad; k++) {
+         for (long i(0); i < m_nlat; i++) {
+            for (long j(0); j < nlon(); j++) {
+               size_t indx(index(i, j, k, l));
+               bool found(false);
+               for (size_t n(0); n < known.size() && !found; n++) {
+                  found = known[n]->node(m_lat_min + i, j, m_rad_min + k,
+                                         m_epoch_min + l, geolat[indx]);
+               }
+               if (!found) {
+                  missing.push_back(indx);
+               }
+            }
+         }
+      }
+   }
+   if (missing.size() > max_missing) {
+      return false;
+   }
+
+   std::vector<float> x(missing.size()), y(missing.size()), z(missing.size());
+   std::vector<double> met(missing.size());
+   for (size_t n(0); n < missing.size(); n++) {
+      size_t indx(missing[n]);
+      long j(indx % nlon());
+      long i((indx/nlon()) % m_nlat);
+      long k((indx/(nlon()*m_nlat)) % m_nrad);
+      long l(indx/(nlon()*m_nlat*m_nrad));
+      double epoch((m_epoch_min + l)*epoch_step);
+      double radius((m_rad_min + k)*rad_step*1e3);
+      double lat((m_lat_min + i)*lat_step*deg);
+      double phi((j*lon_step + gmst(epoch))*deg);
+      x[n] = radius*std::cos(lat)*std::cos(phi);
+      y[n] = radius*std::cos(lat)*std::sin(phi);
+      z[n] = radius*std::sin(lat);
+      met[n] = epoch;
+   }
+   GeomagBatch exact(m_nworkers);
+   exact.compute(x, y, z, met);
+
+// The SAA flag of a latitude/longitude node combines the flags of the
+// known grids that have it with those of its newly evaluated nodes.
+   std::vector<int> saa(m_nlat*nlon(), -1);
+   for (long i(0); i < m_nlat; i++) {
+      for (size_t n(0); n < known.size(); n++) {
+         long ilat(m_lat_min + i - known[n]->m_lat_min);
+         if (known[n]->m_geolat.empty() 
+             || ilat < 0 || ilat >= known[n]->m_nlat) {
+            continue;
+         }
+         for (long j(0); j < nlon(); j++) {
+            combineSaa(saa[i*nlon() + j], known[n]->m_saa[ilat*nlon() + j]);
+         }
+      }
+   }
+   for (size_t n(0); n < missing.size(); n++) {
+      geolat[missing[n]] = exact.geolat()[n];
+      combineSaa(saa[missing[n] % (m_nlat*nlon())], exact.in_saa()[n]);
+   }
+   m_geolat.swap(geolat);
+   m_saa.assign(saa.begin(), saa.end());
+   return true;
+}
+
+bool GeomagGrid::read(const std::string & cachefile) {
+   std::ifstream cache(cachefile.c_str());
+   if (!cache) {
+      return false;
+   }
+   std::string version;
+   double steps[4];
+   cache >> version >> steps[0] >> steps[1] >> steps[2] >> steps[3];
+   if (!cache || version != cache_version
+       || steps[0] != lat_step || steps[1] != lon_step
+       || steps[2] != rad_step || steps[3] != epoch_step) {
+      return false;
+   }
+   long lat_min, nlat, rad_min, nrad, epoch_min, nepoch;
+   cache >> lat_min >> nlat >> rad_min >> nrad >> epoch_min >> nepoch;
+   if (!cache || nlat < 2 || nrad < 2 || nepoch < 2) {
+      return false;
+   }
+   std::vector<double> geolat(nepoch*nrad*nlat*nlon());
+   for (size_t i(0); i < geolat.size() && cache; i++) {
+      cache >> geolat[i];
+   }
+   std::vector<char> saa(nlat*nlon());
+   for (size_t i(0); i < saa.size() && cache; i++) {
+      int flag;
+      cache >> flag;
+      saa[i] = flag;
+   }
+   if (!cache) {
+      return false;
+   }
+   m_lat_min = lat_min;
+   m_nlat = nlat;
+   m_rad_min = rad_min;
+   m_nrad = nrad;
+   m_epoch_min = epoch_min;
+   m_nepoch = nepoch;
+   m_geolat.swap(geolat);
+   m_saa.swap(saa);
+   return true;
+}
+
+bool GeomagGrid::write(const std::string & cachefile) const {
+// Write to a temporary file and rename it so that concurrent jobs
+// sharing the cache never see a partial grid.
+   std::ostringstream tmpname;
+   tmpname << cachefile << ".tmp" << getpid();
+   std::ofstream cache(tmpname.str().c_str());
+   cache << cache_version << "\n" << std::setprecision(17)
+         << lat_step << " " << lon_step << " "
+         << rad_step << " " << epoch_step << "\n"
+         << m_lat_min << " " << m_nlat << " "
+         << m_rad_min << " " << m_nrad << " "
+         << m_epoch_min << " " << m_nepoch << "\n";
+   for (size_t i(0); i < m_geolat.size(); i++) {
+      cache << m_geolat[i] << "\n";
+   }
+   for (long i(0); i < m_nlat; i++) {
+      for (long j(0); j < nlon(); j++) {
+         cache << static_cast<int>(m_saa[i*nlon() + j]) << " ";
+      }
+      cache << "\n";
+   }
+   cache.close();
+   if (!cache || std::rename(tmpname.str().c_str(), cachefile.c_str()) != 0) {
+      std::remove(tmpname.str().c_str());
+      return false;
+   }
+   return true;
+}
+
+} // namespace fitsGenApps
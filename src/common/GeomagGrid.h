@@ -0,0 +1,141 @@
+/**
+ * @file GeomagGrid.h
+ * @brief Lookup grids of geomagnetic latitude and SAA membership for
+ * the orbital shell covered by a set of spacecraft positions.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_GeomagGrid_h
+#define fitsGenApps_GeomagGrid_h
+
+#include <string>
+#include <vector>
+
+namespace fitsGenApps {
+
+/**
+ * @class GeomagGrid
+ * @brief Geomagnetic latitude tabulated on a grid of geocentric
+ * latitude, Earth-fixed longitude, radius and epoch, with an SAA flag
+ * for each latitude/longitude node.
+ *
+ * The nodes lie on a fixed lattice, so a grid built for one data set
+ * can be reused, via a cache file, for any other that it covers, and
+ * extended to cover a new data set by evaluating only the nodes that
+ * it lacks.
+ * Geomagnetic latitude is interpolated multilinearly.  A row is
+ * assigned an SAA flag only if every node of its latitude/longitude
+ * cell and of the eight cells around it agrees at all radii and
+ * epochs; rows near the SAA boundary are left for exact evaluation.
+ *
+ * The SAA flag is only sampled at the nodes, so a part of the SAA
+ * polygon narrower than a cell (0.5 deg in latitude by 1 deg in
+ * longitude) and more than a cell away from the rest of the boundary
+ * would be missed.
+ */
+
+class GeomagGrid {
+
+public:
+
+   GeomagGrid(unsigned int nworkers=1);
+
+   /// Make the grid cover the rows.  The current grid is kept if it
+   /// already does; otherwise it is loaded from cachefile if the
+   /// cached grid covers them.  Failing that, the current and cached
+   /// grids are merged and extended to cover the rows, and the result
+   /// is written to cachefile, with a warning if that fails.  An
+   /// empty cachefile or "none" disables the cache.
+   /// @param sc_x, sc_y, sc_z Spacecraft positions in meters.
+   /// @return false, leaving the grid unchanged, if more nodes would
+   ///         have to be evaluated than there are rows, in which case
+   ///         the rows are better evaluated exactly.
+   bool prepare(const std::vector<float> & sc_x,
+                const std::vector<float> & sc_y,
+                const std::vector<float> & sc_z,
+                const std::vector<double> & met,
+                const std::string & cachefile="");
+
+   /// Interpolate the geomagnetic latitude and look up the SAA flag
+   /// for one row.  Return false if the row is in or next to a cell
+   /// on the SAA boundary, in which case in_saa is not set.
+   bool lookup(float sc_x, float sc_y, float sc_z, double met,
+               double & geolat, bool & in_saa) const;
+
+   /// Whether the last prepare() read the cache file.
+   bool fromCache() const {
+      return m_fromCache;
+   }
+
+   size_t nnodes() const {
+      return m_geolat.size();
+   }
+
+private:
+
+   unsigned int m_nworkers;
+   bool m_fromCache;
+
+/// Index of the first node and number of nodes along each axis other
+/// than longitude, which always spans the full circle.
+   long m_lat_min;
+   long m_nlat;
+   long m_rad_min;
+   long m_nrad;
+   long m_epoch_min;
+   long m_nepoch;
+
+/// Geomagnetic latitude (degrees) at each node.
+   std::vector<double> m_geolat;
+
+/// SAA flag for each latitude/longitude node: 0 outside, 1 inside,
+/// 2 if it changes with radius or epoch.
+   std::vector<char> m_saa;
+
+   struct Coords {
+      double lat;
+      double lon;
+      double radius;
+   };
+
+   static Coords coords(float sc_x, float sc_y, float sc_z, double met);
+
+   /// Greenwich mean sidereal time in degrees.
+   static double gmst(double met);
+
+   size_t index(long ilat, long ilon, long irad, long iepoch) const {
+      return ((iepoch*m_nrad + irad)*m_nlat + ilat)*nlon() + ilon;
+   }
+
+   static long nlon();
+
+   bool covers(long lat_min, long lat_max, long rad_min, long rad_max,
+               long epoch_min, long epoch_max) const;
+
+   /// Enlarge the node ranges to include those of another grid.
+   void include(const GeomagGrid & other);
+
+   /// Geomagnetic latitude at a node given by lattice indices, if
+   /// this grid has it.
+   bool node(long lat, long ilon, long rad, long epoch,
+             double & geolat) const;
+
+   /// Fill the grid, taking the nodes of the known grids from them
+   /// and evaluating the rest exactly.  Return false, without
+   /// evaluating anything, if more than max_missing nodes are needed.
+   bool build(const std::vector<const GeomagGrid *> & known,
+              size_t max_missing);
+
+   bool read(const std::string & cachefile);
+
+   /// @return false if the cache file cannot be written.
+   bool write(const std::string & cachefile) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_GeomagGrid_h
@@ -0,0 +1,144 @@
+/**
+ * @file SkyGeometry.cxx
+ * @brief Spherical geometry on columns of directions.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "SkyGeometry.h"
+
+namespace {
+   const double deg(M_PI/180.);
+
+/// Unit vector for equatorial coordinates in degrees.
+   inline void unitVector(double ra, double dec,
+                          double & x, double & y, double & z) {
+      double cos_dec(std::cos(dec*deg));
+      x = cos_dec*std::cos(ra*deg);
+      y = cos_dec*std::sin(ra*deg);
+      z = std::sin(dec*deg);
+   }
+
+/// Angle (deg) between two unit vectors from half the chord length,
+/// which is accurate for small angles, unlike the arccosine of the
+/// dot product.
+   inline double chordAngle(double dx, double dy, double dz) {
+      return 2.*std::asin(0.5*std::sqrt(dx*dx + dy*dy + dz*dz))/deg;
+   }
+
+   void checkSizes(const fitsGenApps::UnitVectors & dirs1,
+                   const fitsGenApps::UnitVectors & dirs2) {
+      if (dirs1.size() != dirs2.size()) {
+         throw std::runtime_error("SkyGeometry: direction columns "
+                                  "differ in length.");
+      }
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+void SkyGeometry::unitVectors(const std::vector<double> & ra,
+                              const std::vector<double> & dec,
+                              UnitVectors & dirs) {
+   size_t n(ra.size());
+   if (dec.size() != n) {
+      throw std::runtime_error("SkyGeometry::unitVectors: ra and dec "
+                               "columns differ in length.");
+   }
+   dirs.resize(n);
+   const double * ra_p(n ? &ra[0] : 0);
+   const double * dec_p(n ? &dec[0] : 0);
+   double * x(n ? &dirs.x[0] : 0);
+   double * y(n ? &dirs.y[0] : 0);
+   double * z(n ? &dirs.z[0] : 0);
+   for (size_t i(0); i < n; i++) {
+      unitVector(ra_p[i], dec_p[i], x[i], y[i], z[i]);
+   }
+}
+
+void SkyGeometry::raDec(const UnitVectors & dirs, std::vector<double> & ra,
+                        std::vector<double> & dec) {
+   size_t n(dirs.size());
+   ra.resize(n);
+   dec.resize(n);
+   for (size_t i(0); i < n; i++) {
+      double ra_i(std::atan2(dirs.y[i], dirs.x[i])/deg);
+      ra[i] = ra_i < 0 ? ra_i + 360. : ra_i;
+      dec[i] = std::atan2(dirs.z[i], std::sqrt(dirs.x[i]*dirs.x[i]
+                                               + dirs.y[i]*dirs.y[i]))/deg;
+   }
+}
+
+void SkyGeometry::separations(const UnitVectors & dirs1,
+                              const UnitVectors & dirs2,
+                              std::vector<double> & angles) {
+   checkSizes(dirs1, dirs2);
+   size_t n(dirs1.size());
+   angles.resize(n);
+   for (size_t i(0); i < n; i++) {
+      angles[i] = chordAngle(dirs1.x[i] - dirs2.x[i],
+                             dirs1.y[i] - dirs2.y[i],
+                             dirs1.z[i] - dirs2.z[i]);
+   }
+}
+
+double SkyGeometry::separation(double ra1, double dec1,
+                               double ra2, double dec2) {
+   double x1, y1, z1, x2, y2, z2;
+   unitVector(ra1, dec1, x1, y1, z1);
+   unitVector(ra2, dec2, x2, y2, z2);
+   return chordAngle(x1 - x2, y1 - y2, z1 - z2);
+}
+
+void SkyGeometry::cross(const UnitVectors & dirs1, const UnitVectors & dirs2,
+                        UnitVectors & poles) {
+   checkSizes(dirs1, dirs2);
+   size_t n(dirs1.size());
+   poles.resize(n);
+   for (size_t i(0); i < n; i++) {
+      poles.x[i] = dirs1.y[i]*dirs2.z[i] - dirs1.z[i]*dirs2.y[i];
+      poles.y[i] = dirs1.z[i]*dirs2.x[i] - dirs1.x[i]*dirs2.z[i];
+      poles.z[i] = dirs1.x[i]*dirs2.y[i] - dirs1.y[i]*dirs2.x[i];
+   }
+}
+
+void SkyGeometry::yAxes(const UnitVectors & zhat, const UnitVectors & xhat,
+                        UnitVectors & yhat) {
+   cross(zhat, xhat, yhat);
+   for (size_t i(0); i < yhat.size(); i++) {
+      double ymag(std::sqrt(yhat.x[i]*yhat.x[i] + yhat.y[i]*yhat.y[i]
+                            + yhat.z[i]*yhat.z[i]));
+      yhat.x[i] /= ymag;
+      yhat.y[i] /= ymag;
+      yhat.z[i] /= ymag;
+   }
+}
+
+void SkyGeometry::thetaPhi(const UnitVectors & zhat, const UnitVectors & xhat,
+                           const UnitVectors & yhat,
+                           double src_x, double src_y, double src_z,
+                           std::vector<double> & theta,
+                           std::vector<double> & phi) {
+   checkSizes(zhat, xhat);
+   checkSizes(zhat, yhat);
+   size_t n(zhat.size());
+   theta.resize(n);
+   phi.resize(n);
+   for (size_t i(0); i < n; i++) {
+      double cos_theta(src_x*zhat.x[i] + src_y*zhat.y[i] + src_z*zhat.z[i]);
+      theta[i] = std::acos(std::min(std::max(cos_theta, -1.), 1.))/deg;
+      double sx(src_x*xhat.x[i] + src_y*xhat.y[i] + src_z*xhat.z[i]);
+      double sy(src_x*yhat.x[i] + src_y*yhat.y[i] + src_z*yhat.z[i]);
+      double phi_i(std::atan2(sy, sx)/deg);
+      phi[i] = phi_i < 0 ? phi_i + 360. : phi_i;
+   }
+}
+
+} // namespace fitsGenApps
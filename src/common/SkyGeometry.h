@@ -0,0 +1,99 @@
+/**
+ * @file SkyGeometry.h
+ * @brief Spherical geometry on columns of directions.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_SkyGeometry_h
+#define fitsGenApps_SkyGeometry_h
+
+#include <vector>
+
+namespace fitsGenApps {
+
+/**
+ * @class UnitVectors
+ * @brief Cartesian components of a set of directions, stored as one
+ * column per component.
+ */
+
+struct UnitVectors {
+
+   std::vector<double> x;
+   std::vector<double> y;
+   std::vector<double> z;
+
+   size_t size() const {
+      return x.size();
+   }
+
+   void resize(size_t n) {
+      x.resize(n);
+      y.resize(n);
+      z.resize(n);
+   }
+
+};
+
+/**
+ * @class SkyGeometry
+ * @brief The per-row astro::SkyDir operations of the FT2 tools,
+ * applied to whole columns at once.  Each function is a single loop
+ * over plain arrays, with no temporary objects, and gives the same
+ * results as the corresponding SkyDir and CLHEP::Hep3Vector
+ * operations to within rounding.  Angles are in degrees.
+ */
+
+class SkyGeometry {
+
+public:
+
+   /// Unit vectors for equatorial coordinates, as for
+   /// astro::SkyDir(ra, dec).dir().
+   static void unitVectors(const std::vector<double> & ra,
+                           const std::vector<double> & dec,
+                           UnitVectors & dirs);
+
+   /// Equatorial coordinates of (not necessarily unit) vectors, as
+   /// for astro::SkyDir(vector).ra() and .dec().
+   static void raDec(const UnitVectors & dirs, std::vector<double> & ra,
+                     std::vector<double> & dec);
+
+   /// Angle between corresponding directions, as for
+   /// astro::SkyDir::difference().
+   static void separations(const UnitVectors & dirs1,
+                           const UnitVectors & dirs2,
+                           std::vector<double> & angles);
+
+   /// Angle between two directions given in equatorial coordinates,
+   /// for code that works a row at a time.
+   static double separation(double ra1, double dec1,
+                            double ra2, double dec2);
+
+   /// Cross products dirs1 x dirs2, e.g., the orbit poles from
+   /// successive spacecraft positions.
+   static void cross(const UnitVectors & dirs1, const UnitVectors & dirs2,
+                     UnitVectors & poles);
+
+   /// Instrument y-axes, yhat = -(xhat x zhat), normalized since the
+   /// z- and x-axes need not be exactly orthogonal.
+   static void yAxes(const UnitVectors & zhat, const UnitVectors & xhat,
+                     UnitVectors & yhat);
+
+   /// Instrument coordinates of a source direction, as computed by
+   /// add_source_info: theta is the angle from the z-axis, and phi is
+   /// the azimuth from the x-axis towards the y-axis, in [0, 360).
+   static void thetaPhi(const UnitVectors & zhat, const UnitVectors & xhat,
+                        const UnitVectors & yhat,
+                        double src_x, double src_y, double src_z,
+                        std::vector<double> & theta,
+                        std::vector<double> & phi);
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_SkyGeometry_h
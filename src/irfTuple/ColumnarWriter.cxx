@@ -0,0 +1,136 @@
+/**
+ * @file ColumnarWriter.cxx
+ * @brief Writer of the columnar irfTuple output format.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ColumnarWriter.h"
+
+namespace {
+   using fitsGenApps::ColumnarField;
+   using fitsGenApps::ColumnarHeader;
+
+/// Column offsets for nrows rows, and the resulting file size.
+   uint64_t layout(const std::vector<ColumnarField::Type> & types,
+                   uint64_t nrows, std::vector<uint64_t> & offsets) {
+      uint64_t offset(ColumnarHeader::aligned(sizeof(ColumnarHeader)
+                                              + types.size()
+                                              *sizeof(ColumnarField)));
+      offsets.resize(types.size());
+      for (size_t k(0); k < types.size(); k++) {
+         offsets[k] = offset;
+         uint64_t size(nrows*ColumnarField::elementSize(types[k]));
+         offset += ColumnarHeader::aligned(size);
+      }
+      return offset;
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+ColumnarWriter::
+ColumnarWriter(const std::string & filename,
+               const std::vector<std::string> & names,
+               const std::vector<ColumnarField::Type> & types,
+               uint64_t capacity)
+   : m_filename(filename), m_fd(-1), m_data(0), m_size(0),
+     m_capacity(capacity), m_names(names), m_types(types) {
+   if (names.size() != types.size()) {
+      throw std::runtime_error("ColumnarWriter: numbers of column names "
+                               "and types differ.");
+   }
+   for (size_t k(0); k < names.size(); k++) {
+      if (names[k].size() >= sizeof(ColumnarField().name)) {
+         throw std::runtime_error("ColumnarWriter: column name too long: "
+                                  + names[k]);
+      }
+   }
+   m_size = layout(m_types, m_capacity, m_offsets);
+   m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (m_fd < 0) {
+      throw std::runtime_error("ColumnarWriter: cannot create " + m_filename);
+   }
+// Writing to pages of the map that have no disk space behind them
+// raises SIGBUS, so the space is allocated, not just reserved by
+// extending the file.
+   int status(posix_fallocate(m_fd, 0, m_size));
+   if (status != 0) {
+      ::close(m_fd);
+      m_fd = -1;
+      std::remove(m_filename.c_str());
+      throw std::runtime_error("ColumnarWriter: cannot allocate space for "
+                               + m_filename + ": " + std::strerror(status));
+   }
+   void * addr(mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0));
+   if (addr == MAP_FAILED) {
+      ::close(m_fd);
+      m_fd = -1;
+      throw std::runtime_error("ColumnarWriter: cannot map " + m_filename);
+   }
+   m_data = static_cast<char *>(addr);
+}
+
+ColumnarWriter::~ColumnarWriter() throw() {
+   if (m_data) {
+      munmap(m_data, m_size);
+   }
+   if (m_fd >= 0) {
+      ::close(m_fd);
+   }
+}
+
+void ColumnarWriter::close(uint64_t nrows) {
+   if (nrows > m_capacity) {
+      throw std::runtime_error("ColumnarWriter: more rows than allocated.");
+   }
+// Move the columns down to their offsets for nrows rows.  These never
+// exceed the original offsets, so the columns can be moved in order.
+   std::vector<uint64_t> offsets;
+   uint64_t size(layout(m_types, nrows, offsets));
+   for (size_t k(0); k < m_types.size(); k++) {
+      if (offsets[k] != m_offsets[k]) {
+         std::memmove(m_data + offsets[k], m_data + m_offsets[k],
+                      nrows*ColumnarField::elementSize(m_types[k]));
+      }
+   }
+   ColumnarHeader * header(reinterpret_cast<ColumnarHeader *>(m_data));
+   std::memset(header, 0, offsets.empty() ? sizeof(ColumnarHeader)
+               : offsets.front());
+   std::memcpy(header->magic, ColumnarHeader::magicString(),
+               sizeof(header->magic));
+   header->byte_order = ColumnarHeader::ORDER_MARK;
+   header->version = ColumnarHeader::FORMAT_VERSION;
+   header->nrows = nrows;
+   header->ncols = m_types.size();
+   ColumnarField * fields(reinterpret_cast<ColumnarField *>(header + 1));
+   for (size_t k(0); k < m_types.size(); k++) {
+      std::strncpy(fields[k].name, m_names[k].c_str(),
+                   sizeof(fields[k].name) - 1);
+      fields[k].type = m_types[k];
+      fields[k].offset = offsets[k];
+   }
+
+   munmap(m_data, m_size);
+   m_data = 0;
+   int status(ftruncate(m_fd, size));
+   status |= ::close(m_fd);
+   m_fd = -1;
+   if (status != 0) {
+      throw std::runtime_error("ColumnarWriter: cannot finish writing "
+                               + m_filename);
+   }
+}
+
+} // namespace fitsGenApps
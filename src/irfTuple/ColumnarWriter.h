@@ -0,0 +1,69 @@
+/**
+ * @file ColumnarWriter.h
+ * @brief Writer of the columnar irfTuple output format described in
+ * fitsGenApps/ColumnarFile.h.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_ColumnarWriter_h
+#define fitsGenApps_ColumnarWriter_h
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "fitsGenApps/ColumnarFile.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class ColumnarWriter
+ * @brief Writes a columnar file through a shared memory map of it.
+ * The disk space for a maximum number of rows is allocated when the
+ * file is created, so that running out of space is reported then
+ * rather than as a SIGBUS on writing to the map, and the file is
+ * compacted to the rows actually written by close().
+ */
+
+class ColumnarWriter {
+
+public:
+
+   ColumnarWriter(const std::string & filename,
+                  const std::vector<std::string> & names,
+                  const std::vector<ColumnarField::Type> & types,
+                  uint64_t capacity);
+
+   ~ColumnarWriter() throw();
+
+   void set(size_t col, uint64_t row, double value) {
+      if (m_types[col] == ColumnarField::FLOAT32) {
+         reinterpret_cast<float *>(m_data + m_offsets[col])[row] = value;
+      } else {
+         reinterpret_cast<double *>(m_data + m_offsets[col])[row] = value;
+      }
+   }
+
+   /// Keep the first nrows rows, close the file, and unmap it.
+   void close(uint64_t nrows);
+
+private:
+
+   std::string m_filename;
+   int m_fd;
+   char * m_data;
+   size_t m_size;
+   uint64_t m_capacity;
+   std::vector<std::string> m_names;
+   std::vector<ColumnarField::Type> m_types;
+   std::vector<uint64_t> m_offsets;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_ColumnarWriter_h
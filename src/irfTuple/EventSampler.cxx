@@ -0,0 +1,89 @@
+/**
+ * @file EventSampler.cxx
+ * @brief Single-pass uniform or stratified sampling of merit events.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "EventSampler.h"
+
+namespace fitsGenApps {
+
+EventSampler::EventSampler(size_t nkeep, double logE_width,
+                           double zdir_width, unsigned int seed)
+   : m_nkeep(nkeep), m_logE_width(logE_width), m_zdir_width(zdir_width),
+     m_generator(seed), m_nseen(0) {
+   if (nkeep == 0) {
+      throw std::runtime_error("EventSampler: at least one event "
+                               "per stratum must be kept.");
+   }
+   if (logE_width < 0 || zdir_width < 0) {
+      throw std::runtime_error("EventSampler: negative stratum width.");
+   }
+}
+
+std::vector<double> * EventSampler::offer(double logE, double zdir) {
+   Stratum & stratum(m_strata[std::make_pair(bin(logE, m_logE_width),
+                                             bin(zdir, m_zdir_width))]);
+   long index(m_nseen++);
+   stratum.nseen++;
+// Algorithm R: the nth event of a stratum replaces a random one of
+// the nkeep kept so far with probability nkeep/n.
+   Event * event(0);
+   if (stratum.events.size() < m_nkeep) {
+      stratum.events.push_back(Event());
+      event = &stratum.events.back();
+   } else {
+      std::uniform_int_distribution<long> slot(0, stratum.nseen - 1);
+      long k(slot(m_generator));
+      if (k >= static_cast<long>(m_nkeep)) {
+         return 0;
+      }
+      event = &stratum.events[k];
+   }
+   event->index = index;
+   return &event->values;
+}
+
+void EventSampler::sample(std::vector<const std::vector<double> *> & events,
+                          std::vector<double> & weights) const {
+   std::vector<std::pair<long, size_t> > order;
+   std::vector<const Event *> kept;
+   std::vector<double> kept_weights;
+   std::map<std::pair<long, long>, Stratum>::const_iterator
+      stratum(m_strata.begin());
+   for ( ; stratum != m_strata.end(); ++stratum) {
+      const std::vector<Event> & stratum_events(stratum->second.events);
+      double weight(static_cast<double>(stratum->second.nseen)
+                    /stratum_events.size());
+      for (size_t k(0); k < stratum_events.size(); k++) {
+         order.push_back(std::make_pair(stratum_events[k].index,
+                                        kept.size()));
+         kept.push_back(&stratum_events[k]);
+         kept_weights.push_back(weight);
+      }
+   }
+   std::sort(order.begin(), order.end());
+   events.clear();
+   weights.clear();
+   for (size_t k(0); k < order.size(); k++) {
+      events.push_back(&kept[order[k].second]->values);
+      weights.push_back(kept_weights[order[k].second]);
+   }
+}
+
+long EventSampler::bin(double value, double width) const {
+   if (width == 0) {
+      return 0;
+   }
+   return static_cast<long>(std::floor(value/width));
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,85 @@
+/**
+ * @file EventSampler.h
+ * @brief Single-pass uniform or stratified sampling of merit events.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_EventSampler_h
+#define fitsGenApps_EventSampler_h
+
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace fitsGenApps {
+
+/**
+ * @class EventSampler
+ * @brief Keeps a reservoir of at most nkeep events in each stratum of
+ * McLogEnergy and McZDir, so that every event offered to a stratum
+ * has the same chance of being kept.  Each kept event carries the
+ * weight nseen/nkept of its stratum, which restores the original
+ * event counts in weighted sums.  With bin widths of zero there is a
+ * single stratum, i.e., a uniform sample of the whole input.
+ */
+
+class EventSampler {
+
+public:
+
+   /// @param nkeep Number of events to keep per stratum
+   /// @param logE_width Width of the McLogEnergy strata (0 for one)
+   /// @param zdir_width Width of the McZDir strata (0 for one)
+   /// @param seed Seed for the choice of events
+   EventSampler(size_t nkeep, double logE_width=0, double zdir_width=0,
+                unsigned int seed=1);
+
+   /// Offer the next event of the input.
+   /// @return The values to be filled for the event if it is kept,
+   /// replacing an earlier one in its stratum, or 0 if it is dropped.
+   std::vector<double> * offer(double logE, double zdir);
+
+   /// The kept events in input order, and their weights.
+   void sample(std::vector<const std::vector<double> *> & events,
+               std::vector<double> & weights) const;
+
+   long nseen() const {
+      return m_nseen;
+   }
+
+   size_t nstrata() const {
+      return m_strata.size();
+   }
+
+private:
+
+   struct Event {
+      long index;
+      std::vector<double> values;
+   };
+
+   struct Stratum {
+      Stratum() : nseen(0) {}
+      long nseen;
+      std::vector<Event> events;
+   };
+
+   size_t m_nkeep;
+   double m_logE_width;
+   double m_zdir_width;
+   std::mt19937 m_generator;
+   long m_nseen;
+
+   std::map<std::pair<long, long>, Stratum> m_strata;
+
+   long bin(double value, double width) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_EventSampler_h
@@ -14,6 +14,9 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#include <unistd.h>
 
 #include "dataSubselector/Gti.h"
 #include "dataSubselector/Cuts.h"
@@ -29,35 +32,211 @@
 #include "fitsGen/Ft1File.h"
 #include "fitsGen/MeritFile.h"
 
+#include "ColumnarWriter.h"
+#include "EventSampler.h"
+
 using namespace fitsGen;
 
-int main(int iargc, char * argv[]) {
-   if (iargc < 3) {
+namespace {
+   void usage(char * argv[]) {
       std::cout << "usage: " << argv[0] 
-                << " <merit file> <output FITS file>"
-                << " [<filter_string> [<irfTupleNameFile>]]";
+                << " [-c] [-n <nevents> | -s <nevents> [-b <dlogE>,<dzdir>]]"
+                << " [-r <seed>]\n      <merit file> <output FITS file>"
+                << " [<filter_string> [<irfTupleNameFile>]]\n\n"
+                << "  -c  write a memory-mappable columnar file "
+                << "instead of FITS\n"
+                << "  -n  keep a uniform random sample of nevents events\n"
+                << "  -s  keep nevents events in each McLogEnergy, McZDir "
+                << "bin\n"
+                << "  -b  bin widths for -s (default 0.25,0.1)\n"
+                << "  -r  random number seed (default 1)\n\n"
+                << "Sampled outputs have a WEIGHT column of the number of "
+                << "input events\nrepresented by each event." << std::endl;
+      std::exit(1);
+   }
+
+/// Fill the merit values of the events kept by the sampler.
+   void sampleEvents(fitsGen::MeritFile & merit,
+                     const std::vector<std::string> & variableNames,
+                     fitsGenApps::EventSampler & sampler) {
+      for ( ; merit.itor() != merit.end(); merit.next()) {
+         std::vector<double> * values(sampler.offer(merit["McLogEnergy"],
+                                                    merit["McZDir"]));
+         if (values == 0) {
+            continue;
+         }
+         values->resize(variableNames.size() + 1);
+         (*values)[0] = merit["EvtElapsedTime"];
+         for (size_t k(0); k < variableNames.size(); k++) {
+            (*values)[k + 1] = merit[variableNames[k]];
+         }
+      }
+   }
+
+/// Create the FITS output with TIME and the tuple variables, and
+/// optionally WEIGHT.
+   void createFields(fitsGen::Ft1File & ft1, const std::string & rootFile,
+                     const std::string & filter,
+                     const std::vector<std::string> & variableNames,
+                     bool weighted) {
+      ft1.header().addHistory("Input merit file: " + rootFile);
+      ft1.header().addHistory("Filter string: " + filter);
+
+      ft1.appendField("TIME", "1D");
+      std::vector<std::string>::const_iterator variable(variableNames.begin());
+      for ( ; variable != variableNames.end(); ++variable) {
+         ft1.appendField(*variable, "1E");
+      }
+      if (weighted) {
+         ft1.appendField("WEIGHT", "1E");
+      }
+   }
+
+   void writeFits(fitsGen::MeritFile & merit, const std::string & fitsFile,
+                  const std::string & rootFile, const std::string & filter,
+                  const std::vector<std::string> & variableNames) {
+      fitsGen::Ft1File ft1(fitsFile, 0, "EVENTS", "");
+      createFields(ft1, rootFile, filter, variableNames, false);
+      ft1.setNumRows(merit.nrows());
+      int ncount(0);
+      for ( ; merit.itor() != merit.end(); merit.next(), ft1.next()) {
+         ft1["TIME"].set(merit["EvtElapsedTime"]);
+         std::vector<std::string>::const_iterator 
+            variable(variableNames.begin());
+         for ( ; variable != variableNames.end(); ++variable) {
+            ft1[*variable].set(merit[*variable]);
+         }
+         ncount++;
+      }
+      std::cout << "number of rows processed: " << ncount << std::endl;
+
+      ft1.setNumRows(ncount);
+   }
+
+/// Write the sampled events as FITS, with their weights.
+   void writeFits(const std::vector<const std::vector<double> *> & events,
+                  const std::vector<double> & weights,
+                  const std::string & fitsFile, const std::string & rootFile,
+                  const std::string & filter,
+                  const std::vector<std::string> & variableNames) {
+      fitsGen::Ft1File ft1(fitsFile, 0, "EVENTS", "");
+      createFields(ft1, rootFile, filter, variableNames, true);
+      ft1.setNumRows(events.size());
+      for (size_t i(0); i < events.size(); i++, ft1.next()) {
+         const std::vector<double> & values(*events[i]);
+         ft1["TIME"].set(values[0]);
+         for (size_t k(0); k < variableNames.size(); k++) {
+            ft1[variableNames[k]].set(values[k + 1]);
+         }
+         ft1["WEIGHT"].set(weights[i]);
+      }
    }
-   std::string rootFile(argv[1]);
-   std::string fitsFile(argv[2]);
+
+/// Write the selected merit rows as a columnar file: TIME as double
+/// and the variables as float, as in the FITS output.
+   int writeColumnar(fitsGen::MeritFile & merit, const std::string & outfile,
+                     const std::vector<std::string> & variableNames) {
+      std::vector<std::string> names(1, "TIME");
+      std::vector<fitsGenApps::ColumnarField::Type> 
+         types(1, fitsGenApps::ColumnarField::FLOAT64);
+      names.insert(names.end(), variableNames.begin(), variableNames.end());
+      types.resize(names.size(), fitsGenApps::ColumnarField::FLOAT32);
+      fitsGenApps::ColumnarWriter columns(outfile, names, types, 
+                                          merit.nrows());
+      int ncount(0);
+      for ( ; merit.itor() != merit.end(); merit.next(), ncount++) {
+         columns.set(0, ncount, merit["EvtElapsedTime"]);
+         for (size_t k(0); k < variableNames.size(); k++) {
+            columns.set(k + 1, ncount, merit[variableNames[k]]);
+         }
+      }
+      columns.close(ncount);
+      return ncount;
+   }
+
+/// Write the sampled events as a columnar file, with their weights.
+   void writeColumnar(const std::vector<const std::vector<double> *> & events,
+                      const std::vector<double> & weights,
+                      const std::string & outfile,
+                      const std::vector<std::string> & variableNames) {
+      std::vector<std::string> names(1, "TIME");
+      std::vector<fitsGenApps::ColumnarField::Type> 
+         types(1, fitsGenApps::ColumnarField::FLOAT64);
+      names.insert(names.end(), variableNames.begin(), variableNames.end());
+      names.push_back("WEIGHT");
+      types.resize(names.size(), fitsGenApps::ColumnarField::FLOAT32);
+      fitsGenApps::ColumnarWriter columns(outfile, names, types, 
+                                          events.size());
+      for (size_t i(0); i < events.size(); i++) {
+         const std::vector<double> & values(*events[i]);
+         for (size_t k(0); k < values.size(); k++) {
+            columns.set(k, i, values[k]);
+         }
+         columns.set(values.size(), i, weights[i]);
+      }
+      columns.close(events.size());
+   }
+} // anonymous namespace
+
+int main(int iargc, char * argv[]) {
+   bool columnar(false);
+   long nkeep(0);
+   bool stratify(false);
+   double logE_width(0.25);
+   double zdir_width(0.1);
+   unsigned int seed(1);
+   int opt;
+   while ((opt = getopt(iargc, argv, "cn:s:b:r:")) != -1) {
+      switch (opt) {
+      case 'c':
+         columnar = true;
+         break;
+      case 'n':
+      case 's':
+         if (nkeep != 0 || (nkeep = std::atol(optarg)) <= 0) {
+            usage(argv);
+         }
+         stratify = (opt == 's');
+         break;
+      case 'b':
+         if (std::sscanf(optarg, "%lf,%lf", &logE_width, &zdir_width) != 2
+             || logE_width <= 0 || zdir_width <= 0) {
+            usage(argv);
+         }
+         break;
+      case 'r':
+         seed = std::strtoul(optarg, 0, 10);
+         break;
+      default:
+         usage(argv);
+      }
+   }
+   int nargs(iargc - optind);
+   if (nargs < 2 || nargs > 4) {
+      usage(argv);
+   }
+   char ** args(argv + optind);
+   std::string rootFile(args[0]);
+   std::string fitsFile(args[1]);
 
    std::ostringstream filter;
-   if (iargc >= 4) {
-      if (st_facilities::Util::fileExists(argv[3])) {
+   if (nargs >= 3) {
+      if (st_facilities::Util::fileExists(args[2])) {
          std::vector<std::string> lines;
-         st_facilities::Util::readLines(argv[3], lines, "#", true);
+         st_facilities::Util::readLines(args[2], lines, "#", true);
          for (size_t i = 0; i < lines.size(); i++) {
             filter << lines.at(i);
          }
       } else {
-         filter << argv[3];
+         filter << args[2];
       }
       std::cout << "applying TCut: " << filter.str() << std::endl;
    }
    std::string irfTupleNameFile = 
       facilities::commonUtilities::joinPath(
          st_facilities::Environment::dataPath("fitsGen"), "irfTupleNames");
-   if (iargc == 5) {
-      irfTupleNameFile = argv[4];
+   if (nargs == 4) {
+      irfTupleNameFile = args[3];
    }
 
    std::vector<std::string> variableNames;
@@ -68,36 +247,37 @@ int main(int iargc, char * argv[]) {
       if (st_facilities::Util::fileExists(fitsFile)) {
          std::remove(fitsFile.c_str());
       }
-      fitsGen::Ft1File ft1(fitsFile, 0, "EVENTS", "");
-   
-      ft1.header().addHistory("Input merit file: " + rootFile);
-      ft1.header().addHistory("Filter string: " + filter.str());
-
-      ft1.appendField("TIME", "1D");
-      std::vector<std::string>::const_iterator variable(variableNames.begin());
-      for ( ; variable != variableNames.end(); ++variable) {
-         ft1.appendField(*variable, "1E");
-      }
-      ft1.setNumRows(merit.nrows());
-      int ncount(0);
-      for ( ; merit.itor() != merit.end(); merit.next(), ft1.next()) {
-         ft1["TIME"].set(merit["EvtElapsedTime"]);
-         for (variable = variableNames.begin();
-              variable != variableNames.end(); ++variable) {
-            ft1[*variable].set(merit[*variable]);
+      if (nkeep > 0) {
+         fitsGenApps::EventSampler sampler(nkeep, 
+                                           stratify ? logE_width : 0,
+                                           stratify ? zdir_width : 0, seed);
+         sampleEvents(merit, variableNames, sampler);
+         std::vector<const std::vector<double> *> events;
+         std::vector<double> weights;
+         sampler.sample(events, weights);
+         std::cout << "number of rows processed: " << sampler.nseen() 
+                   << "\nnumber of rows sampled: " << events.size()
+                   << " in " << sampler.nstrata() << " bin(s)" << std::endl;
+         if (columnar) {
+            writeColumnar(events, weights, fitsFile, variableNames);
+         } else {
+            writeFits(events, weights, fitsFile, rootFile, filter.str(),
+                      variableNames);
          }
-         ncount++;
+      } else if (columnar) {
+         int ncount(writeColumnar(merit, fitsFile, variableNames));
+         std::cout << "number of rows processed: " << ncount << std::endl;
+      } else {
+         writeFits(merit, fitsFile, rootFile, filter.str(), variableNames);
       }
-      std::cout << "number of rows processed: " << ncount << std::endl;
-
-      ft1.setNumRows(ncount);
    } catch (std::exception & eObj) {
       std::cout << eObj.what() << std::endl;
       return 1;
    }
-   st_facilities::FitsUtil::writeChecksums(fitsFile);
+   if (!columnar) {
+      st_facilities::FitsUtil::writeChecksums(fitsFile);
+   }
    if (st_facilities::Util::fileExists("dummy.root")) {
       std::remove("dummy.root");
    }
 }
-
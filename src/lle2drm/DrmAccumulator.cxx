@@ -0,0 +1,315 @@
+/**
+ * @file DrmAccumulator.cxx
+ * @brief Histogram of true vs measured energies for MC events, filled
+ * in a single pass over the merit data.
+ *
+ * @author J. Chiang
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "TChain.h"
+#include "TTreeFormula.h"
+
+#include "DrmAccumulator.h"
+
+namespace fitsGenApps {
+
+DrmAccumulator::DrmAccumulator(long ntrue, double log_etrue_min,
+                               double log_etrue_max, long nmeas, 
+                               double log_emeas_min, double log_emeas_max) 
+   : m_ntrue(ntrue), m_xmin(log_etrue_min), m_xmax(log_etrue_max),
+     m_nmeas(nmeas), m_ymin(log_emeas_min), m_ymax(log_emeas_max),
+     m_counts(ntrue*nmeas, 0), m_ngenerated(0), m_nread(0), m_naccepted(0),
+     m_tmin(std::numeric_limits<double>::max()),
+     m_tmax(-std::numeric_limits<double>::max()) {}
+
+void DrmAccumulator::ingest(TChain & mc_data, const std::string & filter,
+                            const std::string & efield,
+                            std::vector<DrmAccumulator> & drms,
+                            const std::vector<const EventCut *> & cuts) {
+   if (!cuts.empty() && cuts.size() != drms.size()) {
+      throw std::runtime_error("DrmAccumulator::ingest: "
+                               "number of cuts and accumulators differ");
+   }
+   bool apply_cuts(false);
+   for (size_t j(0); j < cuts.size(); j++) {
+      if (cuts[j] != 0) {
+         apply_cuts = true;
+      }
+   }
+   std::ostringstream log_emeas;
+   log_emeas << "log10(" << efield << ")";
+   TTreeFormula selection("selection", filter.c_str(), &mc_data);
+   TTreeFormula etrue("etrue", "McLogEnergy", &mc_data);
+   TTreeFormula emeas("emeas", log_emeas.str().c_str(), &mc_data);
+   TTreeFormula time("time", "EvtElapsedTime", &mc_data);
+   TTreeFormula energy("energy", "EvtEnergyCorr", &mc_data);
+   TTreeFormula ra("ra", "FT1Ra", &mc_data);
+   TTreeFormula dec("dec", "FT1Dec", &mc_data);
+   TTreeFormula mc_xdir("mc_xdir", "McXDir", &mc_data);
+   TTreeFormula mc_ydir("mc_ydir", "McYDir", &mc_data);
+   TTreeFormula mc_zdir("mc_zdir", "McZDir", &mc_data);
+   TTreeFormula tkr_xdir("tkr_xdir", "Tkr1XDir", &mc_data);
+   TTreeFormula tkr_ydir("tkr_ydir", "Tkr1YDir", &mc_data);
+   TTreeFormula tkr_zdir("tkr_zdir", "Tkr1ZDir", &mc_data);
+   if (selection.GetNdim() == 0 || emeas.GetNdim() == 0) {
+      throw std::runtime_error("DrmAccumulator::ingest: "
+                               "invalid filter string or energy field");
+   }
+// The formulas for the quantities in MeritEvent are only evaluated if
+// there are cuts to apply.
+   TTreeFormula * formulas[] = {&selection, &etrue, &emeas, &time,
+                                &energy, &ra, &dec, 
+                                &mc_xdir, &mc_ydir, &mc_zdir,
+                                &tkr_xdir, &tkr_ydir, &tkr_zdir};
+   size_t nformulas(apply_cuts ? 13 : 4);
+   MeritEvent event;
+   int tree_number(-1);
+   for (Long64_t entry(0); ; entry++) {
+      Long64_t local_entry(mc_data.LoadTree(entry));
+      if (local_entry < 0) {
+         break;
+      }
+// Formula leaves must be rebound whenever the chain opens a new file.
+      if (mc_data.GetTreeNumber() != tree_number) {
+         tree_number = mc_data.GetTreeNumber();
+         for (size_t i(0); i < nformulas; i++) {
+            formulas[i]->UpdateFormulaLeaves();
+         }
+      }
+      for (size_t j(0); j < drms.size(); j++) {
+         drms[j].m_nread++;
+      }
+      selection.GetNdata();
+      if (selection.EvalInstance() == 0) {
+         continue;
+      }
+      for (size_t i(1); i < nformulas; i++) {
+         formulas[i]->GetNdata();
+      }
+      double log_etrue(etrue.EvalInstance());
+      double log_emeas(emeas.EvalInstance());
+      event.time = time.EvalInstance();
+      if (apply_cuts) {
+         event.energy = energy.EvalInstance();
+         event.ra = ra.EvalInstance();
+         event.dec = dec.EvalInstance();
+         for (size_t k(0); k < 3; k++) {
+            event.mc_dir[k] = formulas[7 + k]->EvalInstance();
+            event.tkr_dir[k] = formulas[10 + k]->EvalInstance();
+         }
+      }
+      for (size_t j(0); j < drms.size(); j++) {
+         if (apply_cuts && cuts[j] != 0 && !(*cuts[j])(event)) {
+            continue;
+         }
+         drms[j].fill(log_etrue, log_emeas);
+         drms[j].addTime(event.time);
+      }
+   }
+}
+
+void DrmAccumulator::fill(double log_etrue, double log_emeas) {
+   m_naccepted++;
+   long ix(binIndex(log_etrue, m_xmin, m_xmax, m_ntrue));
+   long iy(binIndex(log_emeas, m_ymin, m_ymax, m_nmeas));
+   if (ix >= 0 && iy >= 0) {
+      m_counts[ix*m_nmeas + iy] += 1;
+   }
+}
+
+void DrmAccumulator::addTime(double time) {
+   if (time < m_tmin) {
+      m_tmin = time;
+   }
+   if (time > m_tmax) {
+      m_tmax = time;
+   }
+}
+
+void DrmAccumulator::add(const DrmAccumulator & other) {
+   if (other.m_ntrue != m_ntrue || other.m_nmeas != m_nmeas) {
+      throw std::runtime_error("DrmAccumulator::add: binnings differ");
+   }
+   for (size_t i(0); i < m_counts.size(); i++) {
+      m_counts[i] += other.m_counts[i];
+   }
+   m_ngenerated += other.m_ngenerated;
+   m_nread += other.m_nread;
+   m_naccepted += other.m_naccepted;
+   if (other.m_naccepted > 0) {
+      addTime(other.m_tmin);
+      addTime(other.m_tmax);
+   }
+}
+
+void DrmAccumulator::addScaled(const DrmAccumulator & other, double weight) {
+   if (other.m_ntrue != m_ntrue || other.m_nmeas != m_nmeas) {
+      throw std::runtime_error("DrmAccumulator::addScaled: binnings differ");
+   }
+   for (size_t i(0); i < m_counts.size(); i++) {
+      m_counts[i] += weight*other.m_counts[i];
+   }
+}
+
+void DrmAccumulator::scale(double factor) {
+   for (size_t i(0); i < m_counts.size(); i++) {
+      m_counts[i] *= factor;
+   }
+}
+
+double DrmAccumulator::meanRelativeError() const {
+   double total(0), sum_sqrt(0);
+   for (size_t i(0); i < m_counts.size(); i++) {
+      if (m_counts[i] > 0) {
+         total += m_counts[i];
+         sum_sqrt += std::sqrt(m_counts[i]);
+      }
+   }
+   if (total == 0) {
+      return 1;
+   }
+   return sum_sqrt/total;
+}
+
+void DrmAccumulator::clear() {
+   std::fill(m_counts.begin(), m_counts.end(), 0);
+   m_ngenerated = 0;
+   m_nread = 0;
+   m_naccepted = 0;
+   m_tmin = std::numeric_limits<double>::max();
+   m_tmax = -std::numeric_limits<double>::max();
+}
+
+void DrmAccumulator::write(std::ostream & output) const {
+   writeBinning(output);
+   output << "\n"
+          << m_ngenerated << " " << m_nread << " " << m_naccepted << "\n"
+          << m_tmin << " " << m_tmax << "\n";
+   size_t nonzero(m_counts.size() 
+                  - std::count(m_counts.begin(), m_counts.end(), 0.));
+   output << nonzero << "\n";
+   for (size_t i(0); i < m_counts.size(); i++) {
+      if (m_counts[i] != 0) {
+         output << i << " " << m_counts[i] << "\n";
+      }
+   }
+}
+
+void DrmAccumulator::writeBinning(std::ostream & output) const {
+   output << std::setprecision(17)
+          << m_ntrue << " " << m_xmin << " " << m_xmax << " "
+          << m_nmeas << " " << m_ymin << " " << m_ymax;
+}
+
+void DrmAccumulator::read(std::istream & input) {
+   DrmAccumulator other(input);
+   if (other.m_ntrue != m_ntrue || other.m_nmeas != m_nmeas 
+       || other.m_xmin != m_xmin || other.m_xmax != m_xmax 
+       || other.m_ymin != m_ymin || other.m_ymax != m_ymax) {
+      throw std::runtime_error("DrmAccumulator::read: binnings differ");
+   }
+   *this = other;
+}
+
+DrmAccumulator::DrmAccumulator(std::istream & input) {
+   input >> m_ntrue >> m_xmin >> m_xmax >> m_nmeas >> m_ymin >> m_ymax;
+   if (!input || m_ntrue <= 0 || m_nmeas <= 0) {
+      throw std::runtime_error("DrmAccumulator: corrupt input");
+   }
+   m_counts.resize(m_ntrue*m_nmeas, 0);
+   input >> m_ngenerated >> m_nread >> m_naccepted >> m_tmin >> m_tmax;
+   size_t nonzero;
+   input >> nonzero;
+   for (size_t j(0); j < nonzero; j++) {
+      size_t i;
+      double counts;
+      input >> i >> counts;
+      if (!input || i >= m_counts.size()) {
+         throw std::runtime_error("DrmAccumulator: corrupt input");
+      }
+      m_counts[i] = counts;
+   }
+}
+
+void DrmAccumulator::rebinInto(DrmAccumulator & target) const {
+   std::vector<Overlaps_t> xweights, yweights;
+   overlaps(m_ntrue, m_xmin, m_xmax, 
+            target.m_ntrue, target.m_xmin, target.m_xmax, xweights);
+   overlaps(m_nmeas, m_ymin, m_ymax, 
+            target.m_nmeas, target.m_ymin, target.m_ymax, yweights);
+   for (long ix(0); ix < m_ntrue; ix++) {
+      for (long iy(0); iy < m_nmeas; iy++) {
+         double counts(binContent(ix, iy));
+         if (counts == 0) {
+            continue;
+         }
+         const Overlaps_t & xw(xweights[ix]);
+         const Overlaps_t & yw(yweights[iy]);
+         for (size_t i(0); i < xw.size(); i++) {
+            for (size_t j(0); j < yw.size(); j++) {
+               target.m_counts[xw[i].first*target.m_nmeas + yw[j].first]
+                  += counts*xw[i].second*yw[j].second;
+            }
+         }
+      }
+   }
+   target.m_ngenerated += m_ngenerated;
+   target.m_nread += m_nread;
+   target.m_naccepted += m_naccepted;
+   if (m_naccepted > 0) {
+      target.addTime(m_tmin);
+      target.addTime(m_tmax);
+   }
+}
+
+void DrmAccumulator::overlaps(long nbins, double xmin, double xmax,
+                              long ntarget, double tmin, double tmax,
+                              std::vector<Overlaps_t> & weights) {
+// Fractions within 1e-9 of 0 or 1 arise from rounding of coincident
+// bin edges and are snapped so that aligned binnings rebin exactly.
+   const double tol(1e-9);
+   double dx((xmax - xmin)/nbins);
+   double dt((tmax - tmin)/ntarget);
+   weights.assign(nbins, Overlaps_t());
+   for (long i(0); i < nbins; i++) {
+      double lo(xmin + i*dx);
+      double hi(xmin + (i + 1)*dx);
+      long first(std::max(0L, static_cast<long>(std::floor((lo - tmin)/dt))));
+      long last(std::min(ntarget - 1, 
+                         static_cast<long>(std::floor((hi - tmin)/dt))));
+      for (long k(first); k <= last; k++) {
+         double overlap((std::min(hi, tmin + (k + 1)*dt) 
+                         - std::max(lo, tmin + k*dt))/dx);
+         if (overlap < tol) {
+            continue;
+         }
+         if (overlap > 1 - tol) {
+            overlap = 1;
+         }
+         weights[i].push_back(std::make_pair(k, overlap));
+      }
+   }
+}
+
+long DrmAccumulator::binIndex(double x, double xmin, double xmax,
+                              long nbins) {
+// Same bin assignment as TAxis::FindFixBin: the upper edge belongs to
+// the overflow bin.  NaNs (e.g., from log10 of a non-positive energy)
+// fail both comparisons and are rejected.
+   if (!(x >= xmin) || !(x < xmax)) {
+      return -1;
+   }
+   long bin(static_cast<long>(nbins*(x - xmin)/(xmax - xmin)));
+   return bin < nbins ? bin : -1;
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,221 @@
+/**
+ * @file DrmAccumulator.h
+ * @brief Histogram of true vs measured energies for MC events, filled
+ * in a single pass over the merit data.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_DrmAccumulator_h
+#define fitsGenApps_DrmAccumulator_h
+
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+class TChain;
+
+namespace fitsGenApps {
+
+/**
+ * @class MeritEvent
+ * @brief Merit quantities of an event that are available to an
+ * EventCut.
+ */
+
+struct MeritEvent {
+   /// EvtEnergyCorr (MeV)
+   double energy;
+   /// EvtElapsedTime (MET s)
+   double time;
+   /// FT1Ra, FT1Dec (degrees)
+   double ra;
+   double dec;
+   /// McXDir, McYDir, McZDir
+   double mc_dir[3];
+   /// Tkr1XDir, Tkr1YDir, Tkr1ZDir
+   double tkr_dir[3];
+};
+
+/**
+ * @class EventCut
+ * @brief Selection applied event-by-event, in addition to the ROOT
+ * filter string, when filling a DrmAccumulator.
+ */
+
+class EventCut {
+
+public:
+
+   virtual ~EventCut() {}
+
+   virtual bool operator()(const MeritEvent & event) const = 0;
+
+   /// A string that uniquely describes the cut; this is used as part
+   /// of the DrmCache keys.
+   virtual std::string description() const = 0;
+
+};
+
+/**
+ * @class DrmAccumulator
+ * @brief Accumulate counts in bins of log10(true energy) and
+ * log10(measured energy), along with the number of events passing
+ * the cuts and their time range.  The binning follows the TH2D
+ * convention: bins are uniform in each axis and entries falling
+ * outside the axis ranges are counted but not histogrammed.
+ */
+
+class DrmAccumulator {
+
+public:
+
+   DrmAccumulator(long ntrue, double log_etrue_min, double log_etrue_max,
+                  long nmeas, double log_emeas_min, double log_emeas_max);
+
+   /// Create from the output of write(), taking the binning from the
+   /// input.
+   DrmAccumulator(std::istream & input);
+
+   /// Read every entry of the chain once, applying the ROOT filter
+   /// string and filling McLogEnergy vs log10(efield) in each
+   /// accumulator whose cut (if any) the event also passes.
+   /// @param cuts Either empty or one (possibly null) cut per accumulator.
+   static void ingest(TChain & mc_data, const std::string & filter,
+                      const std::string & efield,
+                      std::vector<DrmAccumulator> & drms,
+                      const std::vector<const EventCut *> & cuts);
+
+   void fill(double log_etrue, double log_emeas);
+
+   /// Record the arrival time of an accepted event.
+   void addTime(double time);
+
+   /// Add to the tally of MC-generated events (from the jobinfo tree).
+   void addGenerated(long long generated) {
+      m_ngenerated += generated;
+   }
+
+   /// Add the contents of another accumulator with identical binning.
+   void add(const DrmAccumulator & other);
+
+   /// Add weight times the counts of another accumulator with
+   /// identical binning.  The tallies are not changed.
+   void addScaled(const DrmAccumulator & other, double weight);
+
+   /// Multiply all counts by factor.
+   void scale(double factor);
+
+   void setBinContent(long ktrue, long kmeas, double counts) {
+      m_counts[ktrue*m_nmeas + kmeas] = counts;
+   }
+
+   /// Counts-weighted mean of the Poisson relative errors of the
+   /// bins, sum_i sqrt(n_i)/sum_i n_i, i.e., the relative error of
+   /// the bin of a typical accepted event.
+   double meanRelativeError() const;
+
+   /// Reset all counts, keeping the binning.
+   void clear();
+
+   /// Write the binning parameters on a single line.
+   void writeBinning(std::ostream & output) const;
+
+   /// Write the binning, tallies and non-zero bins as ascii.
+   void write(std::ostream & output) const;
+
+   /// Read contents written by write().  The binning must match.
+   void read(std::istream & input);
+
+   /// Add the contents to an accumulator with a different binning.
+   /// The counts in each bin are taken to be uniformly distributed in
+   /// log energy and are apportioned by the overlap of the bins, so
+   /// the result is exact where the target bin edges coincide with
+   /// edges of this binning.
+   void rebinInto(DrmAccumulator & target) const;
+
+   /// @return Counts in bin (ktrue, kmeas), zero-based.
+   double binContent(long ktrue, long kmeas) const {
+      return m_counts[ktrue*m_nmeas + kmeas];
+   }
+
+   long ntrue() const {
+      return m_ntrue;
+   }
+
+   long nmeas() const {
+      return m_nmeas;
+   }
+
+   /// Binning in log10(true energy) and log10(measured energy).
+   double log_etrue_min() const {
+      return m_xmin;
+   }
+
+   double log_etrue_max() const {
+      return m_xmax;
+   }
+
+   double log_emeas_min() const {
+      return m_ymin;
+   }
+
+   double log_emeas_max() const {
+      return m_ymax;
+   }
+
+   /// Number of entries read from the merit files.
+   long long nread() const {
+      return m_nread;
+   }
+
+   /// Number of MC-generated events.
+   long long ngenerated() const {
+      return m_ngenerated;
+   }
+
+   /// Number of entries passing the filter.
+   long long naccepted() const {
+      return m_naccepted;
+   }
+
+   double tmin() const {
+      return m_tmin;
+   }
+
+   double tmax() const {
+      return m_tmax;
+   }
+
+private:
+
+   long m_ntrue;
+   double m_xmin;
+   double m_xmax;
+   long m_nmeas;
+   double m_ymin;
+   double m_ymax;
+
+   std::vector<double> m_counts;
+
+   long long m_ngenerated;
+   long long m_nread;
+   long long m_naccepted;
+   double m_tmin;
+   double m_tmax;
+
+   static long binIndex(double x, double xmin, double xmax, long nbins);
+
+   /// Target bin indices and overlap fractions for a source bin.
+   typedef std::vector< std::pair<long, double> > Overlaps_t;
+
+   static void overlaps(long nbins, double xmin, double xmax,
+                        long ntarget, double tmin, double tmax,
+                        std::vector<Overlaps_t> & weights);
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_DrmAccumulator_h
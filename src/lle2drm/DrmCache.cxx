@@ -0,0 +1,193 @@
+/**
+ * @file DrmCache.cxx
+ * @brief On-disk cache of the per-merit-file contributions to a DRM.
+ *
+ * @author J. Chiang
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "facilities/commonUtilities.h"
+
+#include "st_stream/StreamFormatter.h"
+
+#include "DrmAccumulator.h"
+#include "DrmCache.h"
+
+namespace {
+   typedef unsigned long long Hash_t;
+
+/// Serializes warnings from caches used on several threads.
+   std::mutex warning_mutex;
+
+/// 64-bit FNV-1a hash.
+   Hash_t fnv1a(const char * data, size_t size, 
+                Hash_t hash=14695981039346656037ULL) {
+      for (size_t i(0); i < size; i++) {
+         hash ^= static_cast<unsigned char>(data[i]);
+         hash *= 1099511628211ULL;
+      }
+      return hash;
+   }
+
+   std::string hexString(Hash_t hash) {
+      std::ostringstream hex;
+      hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+      return hex.str();
+   }
+
+   std::string normalizedFilter(const std::string & filter) {
+      std::string normalized;
+      for (size_t i(0); i < filter.size(); i++) {
+         if (!std::isspace(static_cast<unsigned char>(filter[i]))) {
+            normalized += filter[i];
+         }
+      }
+      return normalized;
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+DrmCache::DrmCache(const std::string & cachedir, const std::string & filter,
+                   const std::string & efield, const DrmAccumulator & drm)
+   : m_cachedir(cachedir), m_writable(true) {
+   std::string normalized(normalizedFilter(filter));
+   std::ostringstream key;
+   key << hexString(fnv1a(normalized.c_str(), normalized.size())) << " "
+       << efield << " ";
+   drm.writeBinning(key);
+   m_key = key.str();
+   if (mkdir(m_cachedir.c_str(), 0755) != 0 && errno != EEXIST) {
+      disable(std::strerror(errno));
+      return;
+   }
+   struct stat buf;
+   if (stat(m_cachedir.c_str(), &buf) != 0 || !S_ISDIR(buf.st_mode)) {
+      disable("not a directory");
+   } else if (access(m_cachedir.c_str(), W_OK | X_OK) != 0) {
+      disable(std::strerror(errno));
+   }
+}
+
+std::string DrmCache::fileFingerprint(const std::string & filename) {
+   struct stat buf;
+   if (stat(filename.c_str(), &buf) != 0) {
+      throw std::runtime_error("DrmCache: cannot stat " + filename);
+   }
+   long long size(buf.st_size);
+   const long long block_size(1 << 20);
+   std::vector<char> block(block_size);
+   std::ifstream file(filename.c_str(), std::ios::binary);
+   file.read(&block[0], std::min(size, block_size));
+   Hash_t hash(fnv1a(&block[0], file.gcount()));
+   if (size > block_size) {
+      file.seekg(std::max(block_size, size - block_size));
+      file.read(&block[0], block_size);
+      hash = fnv1a(&block[0], file.gcount(), hash);
+   }
+   std::ostringstream fingerprint;
+   fingerprint << size << ":" << static_cast<long long>(buf.st_mtime) 
+               << ":" << hexString(hash);
+   return fingerprint.str();
+}
+
+bool DrmCache::read(const std::string & fingerprint, DrmAccumulator & drm,
+                    double & start, double & stop) const {
+   std::string key(entryKey(fingerprint));
+   std::ifstream entry(entryPath(key).c_str());
+   if (!entry) {
+      return false;
+   }
+   std::string stored_key;
+   std::getline(entry, stored_key);
+   if (stored_key != key) {
+      return false;
+   }
+   entry >> start >> stop;
+   try {
+      drm.read(entry);
+   } catch (std::exception &) {
+      drm.clear();
+      return false;
+   }
+   return true;
+}
+
+void DrmCache::write(const std::string & fingerprint,
+                     const DrmAccumulator & drm,
+                     double start, double stop) const {
+   if (!m_writable) {
+      return;
+   }
+   std::string key(entryKey(fingerprint));
+   std::string path(entryPath(key));
+// Write to a temporary file and rename it so that concurrent jobs
+// sharing the cache never see a partial entry.
+   std::ostringstream tmpname;
+   tmpname << path << ".tmp" << getpid();
+   errno = 0;
+   std::ofstream entry(tmpname.str().c_str());
+   entry << key << "\n" 
+         << std::setprecision(17) << start << " " << stop << "\n";
+   drm.write(entry);
+   entry.close();
+   if (!entry || std::rename(tmpname.str().c_str(), path.c_str()) != 0) {
+      std::string reason(errno != 0 ? std::strerror(errno) 
+                         : "write failed");
+      std::remove(tmpname.str().c_str());
+      disable("cannot write " + path + ": " + reason);
+   }
+}
+
+void DrmCache::disable(const std::string & reason) const {
+   if (m_writable.exchange(false)) {
+      std::lock_guard<std::mutex> lock(warning_mutex);
+      st_stream::StreamFormatter formatter("DrmCache", "", 2);
+      formatter.warn() << "DRM cache directory " << m_cachedir << ": "
+                       << reason << "\nContinuing without writing "
+                       << "cache entries." << std::endl;
+   }
+}
+
+std::string DrmCache::listFingerprint(const std::vector<std::string> & files) {
+   Hash_t hash(fnv1a(0, 0));
+   for (size_t i(0); i < files.size(); i++) {
+      struct stat buf;
+      if (stat(files[i].c_str(), &buf) != 0) {
+         throw std::runtime_error("DrmCache: cannot stat " + files[i]);
+      }
+      std::ostringstream entry;
+      entry << files[i] << " " << static_cast<long long>(buf.st_size) << " "
+            << static_cast<long long>(buf.st_mtime) << "\n";
+      hash = fnv1a(entry.str().c_str(), entry.str().size(), hash);
+   }
+   std::ostringstream fingerprint;
+   fingerprint << files.size() << ":" << hexString(hash);
+   return fingerprint.str();
+}
+
+std::string DrmCache::entryKey(const std::string & fingerprint) const {
+   return fingerprint + " " + m_key;
+}
+
+std::string DrmCache::entryPath(const std::string & key) const {
+   return facilities::commonUtilities::joinPath(
+      m_cachedir, hexString(fnv1a(key.c_str(), key.size())) + ".drm");
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,85 @@
+/**
+ * @file DrmCache.h
+ * @brief On-disk cache of the per-merit-file contributions to a DRM.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_DrmCache_h
+#define fitsGenApps_DrmCache_h
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace fitsGenApps {
+
+class DrmAccumulator;
+
+/**
+ * @class DrmCache
+ * @brief Store and retrieve the histogram contribution and jobinfo
+ * tallies of individual merit files.  Entries are keyed by a
+ * fingerprint of the merit file, a hash of the filter string with
+ * whitespace removed, the measured energy field and the binning, so
+ * any change to the cuts or binning results in a cache miss.
+ *
+ * The file fingerprint combines the size, the modification time and
+ * a checksum of the first and last megabyte of the file.  ROOT keeps
+ * its file header and key list at those locations, so rewriting the
+ * file changes the fingerprint without the whole file being read.
+ *
+ * The cache is only an optimization: if the cache directory cannot
+ * be created or an entry cannot be written, a warning is issued once
+ * and further entries are not written.
+ */
+
+class DrmCache {
+
+public:
+
+   DrmCache(const std::string & cachedir, const std::string & filter,
+            const std::string & efield, const DrmAccumulator & drm);
+
+   /// Fingerprint of a merit file, with which its entries are read
+   /// and written.  It is computed once per file and shared by the
+   /// caches of all of the accumulators filled from it.
+   static std::string fileFingerprint(const std::string & meritFile);
+
+   /// @return true if an entry for the merit file with the given
+   /// fingerprint was found and read into drm, along with the jobinfo
+   /// start and stop times.
+   bool read(const std::string & fingerprint, DrmAccumulator & drm,
+             double & start, double & stop) const;
+
+   /// Write an entry for the merit file with the given fingerprint,
+   /// unless writing has been disabled by an earlier failure.  This
+   /// does not throw.
+   void write(const std::string & fingerprint, const DrmAccumulator & drm,
+              double start, double stop) const;
+
+   /// A fingerprint of a list of files, from their names, sizes and
+   /// modification times, that changes if any file is added, removed
+   /// or rewritten.
+   static std::string listFingerprint(const std::vector<std::string> & files);
+
+private:
+
+   std::string m_cachedir;
+   std::string m_key;
+   mutable std::atomic<bool> m_writable;
+
+   /// Stop writing entries, warning on the first call.
+   void disable(const std::string & reason) const;
+
+   /// Full key for a merit file; this is also stored in the entry
+   /// to guard against hash collisions in the entry file names.
+   std::string entryKey(const std::string & fingerprint) const;
+
+   std::string entryPath(const std::string & key) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_DrmCache_h
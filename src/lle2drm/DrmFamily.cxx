@@ -0,0 +1,185 @@
+/**
+ * @file DrmFamily.cxx
+ * @brief Set of DRMs on a grid of off-axis angles, stored as a
+ * multi-extension FITS file.
+ *
+ * @author J. Chiang
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "tip/Header.h"
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
+
+#include "DrmFamily.h"
+
+namespace {
+   std::string extName(size_t i) {
+      std::ostringstream extname;
+      extname << "DRM_" << i;
+      return extname.str();
+   }
+
+   void appendStringField(tip::Table * table, const std::string & name,
+                          const std::string & value) {
+      std::ostringstream format;
+      format << std::max(size_t(1), value.size()) << "A";
+      table->appendField(name, format.str());
+   }
+}
+
+namespace fitsGenApps {
+
+DrmFamily::DrmFamily(const std::string & filter, const std::string & efield,
+                     const std::string & binning, 
+                     const std::string & thetaGrid,
+                     double costheta_min, const std::string & inputs)
+   : m_filter(filter), m_efield(efield), m_binning(binning),
+     m_theta_grid(thetaGrid), m_costheta_min(costheta_min),
+     m_inputs(inputs) {}
+
+DrmFamily::DrmFamily(const std::string & fitsFile) : m_costheta_min(0) {
+   const tip::Table * cuts 
+      = tip::IFileSvc::instance().readTable(fitsFile, "CUTS");
+   long nnodes;
+   cuts->getHeader().getKeyword("NNODES", nnodes);
+   tip::Table::ConstIterator it = cuts->begin();
+   (*it)["FILTER"].get(m_filter);
+   (*it)["EFIELD"].get(m_efield);
+   try {
+      (*it)["BINNING"].get(m_binning);
+      (*it)["THETAGRID"].get(m_theta_grid);
+      (*it)["INPUTS"].get(m_inputs);
+      cuts->getHeader().getKeyword("COSTHMIN", m_costheta_min);
+   } catch (tip::TipException &) {
+      m_binning = m_theta_grid = m_inputs = "";
+   }
+   delete cuts;
+
+   for (long i(0); i < nnodes; i++) {
+      const tip::Table * table 
+         = tip::IFileSvc::instance().readTable(fitsFile, extName(i));
+      const tip::Header & header(table->getHeader());
+      double theta, theta_min, theta_max;
+      header.getKeyword("THETA", theta);
+      header.getKeyword("THETAMIN", theta_min);
+      header.getKeyword("THETAMAX", theta_max);
+      long ntrue, nmeas;
+      double xmin, xmax, ymin, ymax;
+      long ngenerated;
+      header.getKeyword("NTRUE", ntrue);
+      header.getKeyword("LETRMIN", xmin);
+      header.getKeyword("LETRMAX", xmax);
+      header.getKeyword("NMEAS", nmeas);
+      header.getKeyword("LEMSMIN", ymin);
+      header.getKeyword("LEMSMAX", ymax);
+      header.getKeyword("NGENER", ngenerated);
+      DrmAccumulator drm(ntrue, xmin, xmax, nmeas, ymin, ymax);
+      drm.addGenerated(ngenerated);
+      std::vector<double> counts;
+      long ktrue(0);
+      for (tip::Table::ConstIterator row = table->begin();
+           row != table->end() && ktrue < ntrue; ++row, ktrue++) {
+         (*row)["COUNTS"].get(counts);
+         for (long kmeas(0); kmeas < nmeas; kmeas++) {
+            drm.setBinContent(ktrue, kmeas, counts.at(kmeas));
+         }
+      }
+      delete table;
+      addNode(theta, theta_min, theta_max, drm);
+   }
+}
+
+void DrmFamily::addNode(double theta, double theta_min, double theta_max,
+                        const DrmAccumulator & drm) {
+   if (!m_thetas.empty() && theta <= m_thetas.back()) {
+      throw std::runtime_error("DrmFamily::addNode: "
+                               "nodes must be in increasing theta");
+   }
+   m_thetas.push_back(theta);
+   m_theta_mins.push_back(theta_min);
+   m_theta_maxs.push_back(theta_max);
+   m_drms.push_back(drm);
+}
+
+void DrmFamily::write(const std::string & fitsFile) const {
+   tip::IFileSvc & fileSvc(tip::IFileSvc::instance());
+   fileSvc.createFile(fitsFile);
+
+   fileSvc.appendTable(fitsFile, "CUTS");
+   tip::Table * cuts = fileSvc.editTable(fitsFile, "CUTS");
+   appendStringField(cuts, "FILTER", m_filter);
+   appendStringField(cuts, "EFIELD", m_efield);
+   appendStringField(cuts, "BINNING", m_binning);
+   appendStringField(cuts, "THETAGRID", m_theta_grid);
+   appendStringField(cuts, "INPUTS", m_inputs);
+   cuts->setNumRecords(1);
+   cuts->getHeader()["NNODES"].set(static_cast<long>(m_thetas.size()));
+   cuts->getHeader()["COSTHMIN"].set(m_costheta_min);
+   tip::Table::Iterator it = cuts->begin();
+   (*it)["FILTER"].set(m_filter);
+   (*it)["EFIELD"].set(m_efield);
+   (*it)["BINNING"].set(m_binning);
+   (*it)["THETAGRID"].set(m_theta_grid);
+   (*it)["INPUTS"].set(m_inputs);
+   delete cuts;
+
+   for (size_t i(0); i < m_drms.size(); i++) {
+      const DrmAccumulator & drm(m_drms[i]);
+      fileSvc.appendTable(fitsFile, extName(i));
+      tip::Table * table = fileSvc.editTable(fitsFile, extName(i));
+      std::ostringstream format;
+      format << drm.nmeas() << "D";
+      table->appendField("COUNTS", format.str());
+      table->setNumRecords(drm.ntrue());
+      tip::Header & header(table->getHeader());
+      header["THETA"].set(m_thetas[i]);
+      header["THETAMIN"].set(m_theta_mins[i]);
+      header["THETAMAX"].set(m_theta_maxs[i]);
+      header["NTRUE"].set(drm.ntrue());
+      header["LETRMIN"].set(drm.log_etrue_min());
+      header["LETRMAX"].set(drm.log_etrue_max());
+      header["NMEAS"].set(drm.nmeas());
+      header["LEMSMIN"].set(drm.log_emeas_min());
+      header["LEMSMAX"].set(drm.log_emeas_max());
+      header["NGENER"].set(static_cast<long>(drm.ngenerated()));
+      std::vector<double> counts(drm.nmeas());
+      long ktrue(0);
+      for (tip::Table::Iterator row = table->begin();
+           row != table->end(); ++row, ktrue++) {
+         for (long kmeas(0); kmeas < drm.nmeas(); kmeas++) {
+            counts[kmeas] = drm.binContent(ktrue, kmeas);
+         }
+         (*row)["COUNTS"].set(counts);
+      }
+      delete table;
+   }
+}
+
+DrmAccumulator DrmFamily::interpolate(double theta) const {
+   if (m_drms.empty()) {
+      throw std::runtime_error("DrmFamily::interpolate: no nodes");
+   }
+   DrmAccumulator drm(m_drms.front());
+   drm.clear();
+   drm.addGenerated(m_drms.front().ngenerated());
+   if (theta <= m_thetas.front()) {
+      drm.addScaled(m_drms.front(), 1);
+      return drm;
+   }
+   if (theta >= m_thetas.back()) {
+      drm.addScaled(m_drms.back(), 1);
+      return drm;
+   }
+   size_t i(std::upper_bound(m_thetas.begin(), m_thetas.end(), theta)
+            - m_thetas.begin());
+   double weight((theta - m_thetas[i-1])/(m_thetas[i] - m_thetas[i-1]));
+   drm.addScaled(m_drms[i-1], 1. - weight);
+   drm.addScaled(m_drms[i], weight);
+   return drm;
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,100 @@
+/**
+ * @file DrmFamily.h
+ * @brief Set of DRMs on a grid of off-axis angles, stored as a
+ * multi-extension FITS file.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_DrmFamily_h
+#define fitsGenApps_DrmFamily_h
+
+#include <string>
+#include <vector>
+
+#include "DrmAccumulator.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class DrmFamily
+ * @brief DRM accumulators for a list of off-axis angle nodes.  The
+ * counts of every node are scaled to the full generated sample, so
+ * all nodes share the same ngenerated and can be interpolated
+ * directly.
+ *
+ * The FITS file has a CUTS extension giving the filter string, the
+ * energy field, and what else the family was made from, i.e., the
+ * energy binning, the theta grid, the minimum cos(theta) of the MC
+ * generation, and a fingerprint of the merit files.  It is followed
+ * by one DRM_<i> extension per node with a row of measured energy
+ * counts (COUNTS) for each true energy bin.
+ */
+
+class DrmFamily {
+
+public:
+
+   DrmFamily(const std::string & filter, const std::string & efield,
+             const std::string & binning, const std::string & thetaGrid,
+             double costheta_min, const std::string & inputs);
+
+   /// Read a family from a FITS file.
+   DrmFamily(const std::string & fitsFile);
+
+   /// Add a node.  Nodes must be added in order of increasing theta.
+   void addNode(double theta, double theta_min, double theta_max,
+                const DrmAccumulator & drm);
+
+   void write(const std::string & fitsFile) const;
+
+   /// Linear interpolation in theta between the bracketing nodes.
+   /// Angles outside the grid take the nearest node.
+   DrmAccumulator interpolate(double theta) const;
+
+   const std::string & filter() const {
+      return m_filter;
+   }
+
+   const std::string & efield() const {
+      return m_efield;
+   }
+
+   /// DrmAccumulator::writeBinning of the nodes.  This and the other
+   /// inputs are empty for files written before they were recorded.
+   const std::string & binning() const {
+      return m_binning;
+   }
+
+   const std::string & thetaGrid() const {
+      return m_theta_grid;
+   }
+
+   double costhetaMin() const {
+      return m_costheta_min;
+   }
+
+   /// DrmCache::listFingerprint of the merit files.
+   const std::string & inputs() const {
+      return m_inputs;
+   }
+
+private:
+
+   std::string m_filter;
+   std::string m_efield;
+   std::string m_binning;
+   std::string m_theta_grid;
+   double m_costheta_min;
+   std::string m_inputs;
+
+   std::vector<double> m_thetas;
+   std::vector<double> m_theta_mins;
+   std::vector<double> m_theta_maxs;
+   std::vector<DrmAccumulator> m_drms;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_DrmFamily_h
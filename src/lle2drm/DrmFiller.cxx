@@ -0,0 +1,234 @@
+/**
+ * @file DrmFiller.cxx
+ * @brief Fill one or more DRM accumulators from a list of MC merit
+ * files, optionally on several threads and through an on-disk cache.
+ *
+ * @author J. Chiang
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include "RVersion.h"
+#include "TChain.h"
+#include "TROOT.h"
+#include "TThread.h"
+
+#include "DrmCache.h"
+#include "DrmFiller.h"
+
+namespace fitsGenApps {
+
+DrmFiller::DrmFiller() 
+   : m_nthreads(1), m_deterministic(false), m_ncached(0) {}
+
+void DrmFiller::setNumThreads(int nthreads, bool deterministic) {
+   m_nthreads = nthreads;
+   m_deterministic = deterministic;
+}
+
+void DrmFiller::setCacheDir(const std::string & cachedir) {
+   m_cachedir = cachedir;
+}
+
+void DrmFiller::fill(const std::vector<std::string> & meritFiles,
+                     const std::string & filter, const std::string & efield,
+                     std::vector<DrmAccumulator> & drms,
+                     const std::vector<const EventCut *> & cuts) {
+   m_jobs.clear();
+   m_jobs.resize(meritFiles.size());
+   m_ncached = 0;
+
+   std::vector<DrmCache *> caches;
+   if (m_cachedir != "" && m_cachedir != "none") {
+      for (size_t j(0); j < drms.size(); j++) {
+         std::string selection(filter);
+         if (!cuts.empty() && cuts[j] != 0) {
+            selection += " " + cuts[j]->description();
+         }
+         caches.push_back(new DrmCache(m_cachedir, selection, efield,
+                                       drms[j]));
+      }
+   }
+
+   size_t nthreads(std::min(static_cast<size_t>(std::max(m_nthreads, 1)),
+                            meritFiles.size()));
+   if (nthreads == 0) {
+      nthreads = 1;
+   }
+
+// Each worker gets its own copies of the accumulators, cleared, so
+// that only the final reduction touches the caller's accumulators.
+   std::vector<DrmAccumulator> empty(drms);
+   for (size_t j(0); j < empty.size(); j++) {
+      empty[j].clear();
+   }
+   std::vector< std::vector<DrmAccumulator> > partials(nthreads, empty);
+   std::vector<Worker> workers;
+   for (size_t k(0); k < nthreads; k++) {
+      workers.push_back(Worker(meritFiles, filter, efield, partials[k], cuts,
+                               m_jobs, caches));
+   }
+   if (nthreads == 1) {
+      for (size_t i(0); i < meritFiles.size(); i++) {
+         workers[0].process(i);
+      }
+   } else {
+      fillConcurrently(workers, meritFiles.size());
+   }
+   for (size_t j(0); j < caches.size(); j++) {
+      delete caches[j];
+   }
+
+// Reduce in thread order.  The histogram contents are integer counts,
+// so the sums are exact; with contiguous blocks the accumulated event
+// time ranges and tallies are also independent of scheduling.
+   for (size_t k(0); k < nthreads; k++) {
+      if (workers[k].error() != "") {
+         throw std::runtime_error(workers[k].error());
+      }
+      for (size_t j(0); j < drms.size(); j++) {
+         drms[j].add(partials[k][j]);
+      }
+      m_ncached += workers[k].ncached();
+   }
+}
+
+void DrmFiller::fillConcurrently(std::vector<Worker> & workers,
+                                 size_t nfiles) const {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+   ROOT::EnableThreadSafety();
+#else
+   TThread::Initialize();
+#endif
+   size_t nthreads(workers.size());
+// In deterministic mode each thread gets a fixed, contiguous block of
+// files; otherwise threads take the next unprocessed file as they
+// become free.
+   std::atomic<size_t> next_file(0);
+   std::vector<std::thread> threads;
+   for (size_t k(0); k < nthreads; k++) {
+      size_t first(k*nfiles/nthreads);
+      size_t last((k + 1)*nfiles/nthreads);
+      Worker & worker(workers[k]);
+      if (m_deterministic) {
+         threads.push_back(std::thread([&worker, first, last]() {
+                  for (size_t i(first); i < last; i++) {
+                     worker.process(i);
+                  }
+               }));
+      } else {
+         threads.push_back(std::thread([&worker, &next_file, nfiles]() {
+                  size_t i;
+                  while ((i = next_file++) < nfiles) {
+                     worker.process(i);
+                  }
+               }));
+      }
+   }
+   for (size_t k(0); k < nthreads; k++) {
+      threads[k].join();
+   }
+}
+
+void DrmFiller::setBranchStatus(TChain & mc_data) {
+   mc_data.SetBranchStatus("*", 0);
+   mc_data.SetBranchStatus("Evt*", 1);
+   mc_data.SetBranchStatus("FT1*", 1);
+   mc_data.SetBranchStatus("McEnergy", 1);
+   mc_data.SetBranchStatus("McLogEnergy", 1);
+   mc_data.SetBranchStatus("McXDir", 1);
+   mc_data.SetBranchStatus("McYDir", 1);
+   mc_data.SetBranchStatus("McZDir", 1);
+   mc_data.SetBranchStatus("ObfGamState", 1);
+   mc_data.SetBranchStatus("FswGamState", 1);
+   mc_data.SetBranchStatus("TkrNumTracks", 1);
+   mc_data.SetBranchStatus("Tkr1SSDVeto", 1);
+   mc_data.SetBranchStatus("CTB*", 1);
+   mc_data.SetBranchStatus("Pt*", 1);
+   mc_data.SetBranchStatus("GltEngine", 1);
+   mc_data.SetBranchStatus("GltGemEngine", 1);
+   mc_data.SetBranchStatus("CalEnergyRaw", 1);
+   mc_data.SetBranchStatus("VtxAngle", 1);
+   mc_data.SetBranchStatus("Tkr1FirstLayer", 1);
+   mc_data.SetBranchStatus("Tkr1XDir", 1);
+   mc_data.SetBranchStatus("Tkr1YDir", 1);
+   mc_data.SetBranchStatus("Tkr1ZDir", 1);
+}
+
+DrmFiller::Worker::Worker(const std::vector<std::string> & meritFiles,
+                          const std::string & filter,
+                          const std::string & efield,
+                          std::vector<DrmAccumulator> & drms,
+                          const std::vector<const EventCut *> & cuts,
+                          std::vector<JobInfo> & jobs,
+                          const std::vector<DrmCache *> & caches) 
+   : m_meritFiles(&meritFiles), m_filter(filter), m_efield(efield),
+     m_drms(&drms), m_cuts(&cuts), m_jobs(&jobs), m_caches(&caches),
+     m_ncached(0) {}
+
+void DrmFiller::Worker::process(size_t i) {
+   if (m_error != "") {
+      return;
+   }
+   const std::string & meritFile(m_meritFiles->at(i));
+   try {
+      JobInfo & job(m_jobs->at(i));
+      std::vector<DrmAccumulator> partials(*m_drms);
+      for (size_t j(0); j < partials.size(); j++) {
+         partials[j].clear();
+      }
+// The file is only read if any of the accumulators is missing from
+// the cache.  Its fingerprint, which reads part of the file, is
+// computed once for all of the accumulators.
+      std::string fingerprint;
+      if (!m_caches->empty()) {
+         fingerprint = DrmCache::fileFingerprint(meritFile);
+      }
+      bool cached(!m_caches->empty());
+      for (size_t j(0); j < m_caches->size() && cached; j++) {
+         cached = m_caches->at(j)->read(fingerprint, partials[j], 
+                                        job.start, job.stop);
+      }
+      if (cached) {
+         m_ncached++;
+      } else {
+         TChain job_info("jobinfo");
+         job_info.Add(meritFile.c_str());
+         Long64_t generated;
+         Double_t start, stop;
+         job_info.SetBranchAddress("generated", &generated);
+         job_info.SetBranchAddress("start", &start);
+         job_info.SetBranchAddress("stop", &stop);
+         job_info.GetEntry(0);
+         job.start = start;
+         job.stop = stop;
+         for (size_t j(0); j < partials.size(); j++) {
+            partials[j].clear();
+            partials[j].addGenerated(generated);
+         }
+
+         TChain mc_data("MeritTuple");
+         mc_data.Add(meritFile.c_str());
+         setBranchStatus(mc_data);
+         DrmAccumulator::ingest(mc_data, m_filter, m_efield, partials,
+                                *m_cuts);
+         for (size_t j(0); j < m_caches->size(); j++) {
+            m_caches->at(j)->write(fingerprint, partials[j], 
+                                   job.start, job.stop);
+         }
+      }
+      if (!partials.empty()) {
+         job.generated = partials.front().ngenerated();
+      }
+      for (size_t j(0); j < partials.size(); j++) {
+         m_drms->at(j).add(partials[j]);
+      }
+   } catch (std::exception & eObj) {
+      m_error = meritFile + ": " + eObj.what();
+   }
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,120 @@
+/**
+ * @file DrmFiller.h
+ * @brief Fill one or more DRM accumulators from a list of MC merit
+ * files, optionally on several threads and through an on-disk cache.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_DrmFiller_h
+#define fitsGenApps_DrmFiller_h
+
+#include <string>
+#include <vector>
+
+#include "DrmAccumulator.h"
+
+class TChain;
+
+namespace fitsGenApps {
+
+class DrmCache;
+
+/**
+ * @class DrmFiller
+ * @brief Drive a single pass over the merit files, filling every
+ * accumulator in the list.  Each accumulator may have an additional
+ * EventCut applied natively; all share the ROOT filter string.
+ */
+
+class DrmFiller {
+
+public:
+
+   /// MC-generation bookkeeping from the jobinfo tree of a merit file.
+   struct JobInfo {
+      JobInfo() : generated(0), start(0), stop(0) {}
+      long long generated;
+      double start;
+      double stop;
+   };
+
+   DrmFiller();
+
+   /// Fill using nthreads threads, each with its own accumulators.
+   /// If deterministic is true, the merit files are assigned to
+   /// threads in fixed blocks so that the reduction does not depend
+   /// on thread scheduling.
+   void setNumThreads(int nthreads, bool deterministic=false);
+
+   /// Read and store per-merit-file contributions in cachedir.  An
+   /// empty string or "none" disables the cache.
+   void setCacheDir(const std::string & cachedir);
+
+   /// @param drms Accumulators to be filled; their contents are added to.
+   /// @param cuts Per-accumulator cuts; null entries (or an empty
+   ///        vector) select on the filter string alone.
+   void fill(const std::vector<std::string> & meritFiles,
+             const std::string & filter, const std::string & efield,
+             std::vector<DrmAccumulator> & drms,
+             const std::vector<const EventCut *> & cuts
+             =std::vector<const EventCut *>());
+
+   /// jobinfo contents for each merit file read in the last fill().
+   const std::vector<JobInfo> & jobs() const {
+      return m_jobs;
+   }
+
+   /// Number of merit files read from the cache in the last fill().
+   size_t ncached() const {
+      return m_ncached;
+   }
+
+   static void setBranchStatus(TChain & mc_data);
+
+private:
+
+   int m_nthreads;
+   bool m_deterministic;
+   std::string m_cachedir;
+
+   std::vector<JobInfo> m_jobs;
+   size_t m_ncached;
+
+   /// Fill a set of accumulators from the merit files, one file at a
+   /// time.
+   class Worker {
+   public:
+      Worker(const std::vector<std::string> & meritFiles,
+             const std::string & filter,
+             const std::string & efield,
+             std::vector<DrmAccumulator> & drms,
+             const std::vector<const EventCut *> & cuts,
+             std::vector<JobInfo> & jobs,
+             const std::vector<DrmCache *> & caches);
+      void process(size_t i);
+      const std::string & error() const {
+         return m_error;
+      }
+      size_t ncached() const {
+         return m_ncached;
+      }
+   private:
+      const std::vector<std::string> * m_meritFiles;
+      std::string m_filter;
+      std::string m_efield;
+      std::vector<DrmAccumulator> * m_drms;
+      const std::vector<const EventCut *> * m_cuts;
+      std::vector<JobInfo> * m_jobs;
+      const std::vector<DrmCache *> * m_caches;
+      size_t m_ncached;
+      std::string m_error;
+   };
+
+   void fillConcurrently(std::vector<Worker> & workers, size_t nfiles) const;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_DrmFiller_h
@@ -0,0 +1,53 @@
+/**
+ * @file IncidenceCut.cxx
+ * @brief Selection of MC events by true off-axis angle, with a PSF
+ * cut in the instrument frame.
+ *
+ * @author J. Chiang
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <sstream>
+
+#include "IncidenceCut.h"
+
+namespace fitsGenApps {
+
+IncidenceCut::IncidenceCut(double theta, double theta_min, double theta_max)
+   : m_theta(theta), m_theta_min(theta_min), m_theta_max(theta_max),
+     m_cos_min(std::cos(theta_max*M_PI/180.)),
+     m_cos_max(std::cos(theta_min*M_PI/180.)),
+     m_psf(0, 0, theta, 0, 0) {}
+
+bool IncidenceCut::operator()(const MeritEvent & event) const {
+// The MC direction is that of the incoming photon, so the off-axis
+// angle is measured from -z.
+   double costheta(-event.mc_dir[2]);
+   if (costheta <= m_cos_min || costheta > m_cos_max) {
+      return false;
+   }
+   double cos_sep(0);
+   for (size_t k(0); k < 3; k++) {
+      cos_sep += event.mc_dir[k]*event.tkr_dir[k];
+   }
+   double separation(std::acos(std::max(-1., std::min(1., cos_sep)))
+                     *180./M_PI);
+   return separation <= m_psf.radius(event.energy);
+}
+
+std::string IncidenceCut::description() const {
+   std::ostringstream description;
+   description << "IncidenceCut(" << m_theta << ", " 
+               << m_theta_min << ", " << m_theta_max << ")";
+   return description.str();
+}
+
+double IncidenceCut::generatedFraction(double costheta_min) const {
+   double cos_lo(std::max(m_cos_min, costheta_min));
+   double cos_hi(std::max(m_cos_max, costheta_min));
+   return (cos_hi - cos_lo)/(1. - costheta_min);
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,71 @@
+/**
+ * @file IncidenceCut.h
+ * @brief Selection of MC events by true off-axis angle, with a PSF
+ * cut in the instrument frame.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_IncidenceCut_h
+#define fitsGenApps_IncidenceCut_h
+
+#include <string>
+
+#include "DrmAccumulator.h"
+#include "SourceCut.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class IncidenceCut
+ * @brief Accept events whose true off-axis angle, acos(-McZDir), lies
+ * in [theta_min, theta_max) and whose reconstructed direction,
+ * (Tkr1XDir, Tkr1YDir, Tkr1ZDir), lies within the LLE PSF radius of
+ * the true direction.  The PSF radius model is the one lle2drm uses
+ * for a source at off-axis angle theta.  Since the cut does not refer
+ * to a sky position, it can be applied to an MC sample that is
+ * isotropic in the instrument frame.
+ */
+
+class IncidenceCut : public EventCut {
+
+public:
+
+   IncidenceCut(double theta, double theta_min, double theta_max);
+
+   virtual bool operator()(const MeritEvent & event) const;
+
+   virtual std::string description() const;
+
+   /// Fraction of the generated events that fall in the off-axis
+   /// angle range for a sample generated isotropically with
+   /// cos(theta) >= costheta_min.
+   double generatedFraction(double costheta_min) const;
+
+   double theta() const {
+      return m_theta;
+   }
+
+   double theta_min() const {
+      return m_theta_min;
+   }
+
+   double theta_max() const {
+      return m_theta_max;
+   }
+
+private:
+
+   double m_theta;
+   double m_theta_min;
+   double m_theta_max;
+   double m_cos_min;
+   double m_cos_max;
+
+   SourceCut m_psf;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_IncidenceCut_h
@@ -8,17 +8,15 @@
 
 #include <cmath>
 
+#include <algorithm>
 #include <iomanip>
+#include <random>
 #include <sstream>
-
-#include "TCanvas.h"
-#include "TChain.h"
-#include "TEventList.h"
-#include "TFile.h"
-#include "TH2D.h"
+#include <stdexcept>
 
 #include "evtbin/Binner.h"
 
+#include "DrmAccumulator.h"
 #include "MCResponse.h"
 
 namespace fitsGenApps {
@@ -27,118 +25,219 @@ MCResponse::MCResponse(const std::string & spec_file,
                        const evtbin::Binner * true_en_binner,
                        double index,
                        double area) :
-   rspgen::IResponse("P7SOURCE_V6::FRONT", spec_file, true_en_binner),
+   rspgen::IResponse(irfsName(), spec_file, true_en_binner),
    m_nmc(m_true_en_binner->getNumBins()),
    m_emin_mc(m_true_en_binner->getInterval(0).begin()),
    m_emax_mc(m_true_en_binner->getInterval(m_nmc-1).end()),
    m_index(index),
-   m_area(area) {
+   m_area(area),
+   m_nmeas(0) {
 }
 
 MCResponse::~MCResponse() throw() {}
 
 void MCResponse::compute(double true_energy, std::vector<double> & response) {
+   Row values(row(true_energy));
+   response.assign(m_nmeas, 0);
+   std::copy(values.values(), values.values() + values.size(), 
+             response.begin() + values.first());
+}
+
+MCResponse::Row MCResponse::row(double true_energy) const {
    long k(m_true_en_binner->computeIndex(true_energy));
-   response = m_responses.at(k);
+   if (k < 0 || static_cast<size_t>(k) >= m_offsets.size()) {
+      throw std::out_of_range("MCResponse::row: true energy out of range");
+   }
+// Trailing empty rows have offsets equal to m_values.size(), so
+// form the pointer arithmetically rather than by indexing.
+   return Row(m_values.data() + m_offsets[k], m_firsts[k], m_sizes[k],
+              m_nmeas);
 }
 
 void MCResponse::ingestMeritData(const std::vector<std::string> & meritFiles,
                                  const std::string & filter,
                                  double tmin, double tmax,
                                  const std::string & efield) {
-   st_stream::StreamFormatter formatter("MCResponse", "ingestMeritData", 2);
+   std::vector<DrmAccumulator> drms(1, accumulator());
+   m_filler.fill(meritFiles, filter, efield, drms);
+   logFill(m_filler, meritFiles, drms.front());
+   setResponses(drms.front());
+}
 
-   TChain * mc_data = new TChain("MeritTuple");
-   TChain * job_info = new TChain("jobinfo");
+void MCResponse::
+ingestProgressively(const std::vector<std::string> & meritFiles,
+                    const std::string & filter,
+                    const std::string & efield,
+                    size_t nfiles, double precision, unsigned int seed,
+                    const std::string & outfile,
+                    const std::string & resp_tpl) {
+   st_stream::StreamFormatter formatter("MCResponse", 
+                                        "ingestProgressively", 2);
+   std::vector<std::string> shuffled(meritFiles);
+   std::mt19937 generator(seed);
+   std::shuffle(shuffled.begin(), shuffled.end(), generator);
+   nfiles = std::max(nfiles, size_t(1));
 
-   for (size_t i(0); i < meritFiles.size(); i++) {
-      mc_data->Add(meritFiles[i].c_str());
-      job_info->Add(meritFiles[i].c_str());
-   }
+   std::vector<DrmAccumulator> drms(1, accumulator());
+   DrmAccumulator & DRM(drms.front());
+   size_t nread(0);
+   for (size_t checkpoint(1); nread < shuffled.size(); checkpoint++) {
+      std::vector<std::string> batch(shuffled.begin() + nread, 
+                                     shuffled.begin() 
+                                     + std::min(nread + nfiles, 
+                                                shuffled.size()));
+      m_filler.fill(batch, filter, efield, drms);
+      nread += batch.size();
+      setResponses(DRM);
 
-   mc_data->SetBranchStatus("*", 0);
-   mc_data->SetBranchStatus("Evt*", 1);
-   mc_data->SetBranchStatus("FT1*", 1);
-   mc_data->SetBranchStatus("McEnergy", 1);
-   mc_data->SetBranchStatus("McLogEnergy", 1);
-   mc_data->SetBranchStatus("McZDir", 1);
-   mc_data->SetBranchStatus("ObfGamState", 1);
-   mc_data->SetBranchStatus("FswGamState", 1);
-   mc_data->SetBranchStatus("TkrNumTracks", 1);
-   mc_data->SetBranchStatus("Tkr1SSDVeto", 1);
-   mc_data->SetBranchStatus("CTB*", 1);
-   mc_data->SetBranchStatus("Pt*", 1);
-   mc_data->SetBranchStatus("GltEngine", 1);
-   mc_data->SetBranchStatus("GltGemEngine", 1);
-   mc_data->SetBranchStatus("CalEnergyRaw", 1);
-   mc_data->SetBranchStatus("VtxAngle", 1);
-   mc_data->SetBranchStatus("Tkr1FirstLayer", 1);
-
-   double tmin_mc = mc_data->GetMinimum("EvtElapsedTime");
-   double tmax_mc = mc_data->GetMaximum("EvtElapsedTime");
-   if (tmin == 0 && tmax == 0) {
-      tmin = tmin_mc;
-      tmax = tmax_mc;
+      double error(DRM.meanRelativeError());
+      formatter.info() << "Checkpoint " << checkpoint << ": " 
+                       << nread << " of " << shuffled.size() 
+                       << " merit files, " << DRM.naccepted() 
+                       << " events passing cuts, "
+                       << "mean relative error " << error << std::endl;
+      for (long k(0); k < DRM.ntrue(); k++) {
+         for (long kmeas(0); kmeas < DRM.nmeas(); kmeas++) {
+            double counts(DRM.binContent(k, kmeas));
+            if (counts > 0) {
+               formatter.info(4) << k << "  " << kmeas << "  "
+                                 << 1./std::sqrt(counts) << std::endl;
+            }
+         }
+      }
+      if (nread < shuffled.size()) {
+         std::string checkpoint_file(checkpointName(outfile, checkpoint));
+         writeOutput("lle2drm", checkpoint_file, resp_tpl);
+         formatter.info() << "Wrote " << checkpoint_file << std::endl;
+      }
+      if (precision > 0 && error <= precision) {
+         formatter.info() << "Target precision " << precision 
+                          << " reached" << std::endl;
+         break;
+      }
    }
+}
 
-   long ngenerated(0);
-   Long64_t generated;
-   Double_t start, stop;
-   job_info->SetBranchAddress("generated", &generated);
-   job_info->SetBranchAddress("start", &start);
-   job_info->SetBranchAddress("stop", &stop);
-   for (size_t i(0); i < meritFiles.size(); i++) {
-      job_info->GetEntry(i);
-      ngenerated += generated;
-      double dt = stop - start;
-      std::ostringstream tbounds;
-      tbounds << std::setprecision(14) 
-              << "start: " << start << "\n"
-              << "stop: " << stop << "\n";
-      formatter.info(3) << meritFiles[i] << ": " << generated << "\n"
-                        << tbounds.str() 
-                        << "flux: " << generated/dt/m_area << std::endl;
-
+std::string MCResponse::checkpointName(const std::string & outfile,
+                                       size_t checkpoint) {
+   std::ostringstream suffix;
+   suffix << "_ckpt" << std::setw(3) << std::setfill('0') << checkpoint;
+   size_t dot(outfile.rfind('.'));
+   size_t slash(outfile.rfind('/'));
+   if (dot == std::string::npos 
+       || (slash != std::string::npos && dot < slash)) {
+      return outfile + suffix.str();
    }
-   formatter.info() << "Total number of MC-generated events: " 
-                    << ngenerated << std::endl;
+   return outfile.substr(0, dot) + suffix.str() + outfile.substr(dot);
+}
 
+DrmAccumulator MCResponse::accumulator() const {
    int nmeas = m_app_en_binner->getNumBins();
    double emin = m_app_en_binner->getInterval(0).begin();
    double emax = m_app_en_binner->getInterval(nmeas-1).end();
+   return DrmAccumulator(m_nmc, std::log10(m_emin_mc), std::log10(m_emax_mc),
+                         nmeas, std::log10(emin), std::log10(emax));
+}
 
-   TH2D DRM("DRM", "DRM", m_nmc, std::log10(m_emin_mc), std::log10(m_emax_mc),
-            nmeas, std::log10(emin), std::log10(emax));
+void MCResponse::rebinResponses(const DrmAccumulator & master) {
+   DrmAccumulator drm(accumulator());
+// Counts outside the master's ranges are not available, so the
+// rebinned response would be too low where the binnings do not overlap.
+   const double tol(1e-9);
+   st_stream::StreamFormatter formatter("MCResponse", "rebinResponses", 2);
+   if (drm.log_etrue_min() < master.log_etrue_min() - tol
+       || drm.log_etrue_max() > master.log_etrue_max() + tol) {
+      formatter.warn() << "WARNING: true energies " 
+                       << std::pow(10., drm.log_etrue_min()) << " to " 
+                       << std::pow(10., drm.log_etrue_max()) 
+                       << " MeV extend beyond the master DRM range of "
+                       << std::pow(10., master.log_etrue_min()) << " to " 
+                       << std::pow(10., master.log_etrue_max()) 
+                       << " MeV" << std::endl;
+   }
+   if (drm.log_emeas_min() < master.log_emeas_min() - tol
+       || drm.log_emeas_max() > master.log_emeas_max() + tol) {
+      formatter.warn() << "WARNING: measured energy channels " 
+                       << std::pow(10., drm.log_emeas_min()) << " to " 
+                       << std::pow(10., drm.log_emeas_max()) 
+                       << " MeV extend beyond the master DRM range of "
+                       << std::pow(10., master.log_emeas_min()) << " to " 
+                       << std::pow(10., master.log_emeas_max()) 
+                       << " MeV; the response is zero outside it." 
+                       << std::endl;
+   }
+   master.rebinInto(drm);
+   setResponses(drm);
+}
 
-   TCanvas canvas("DRM_CANVAS", "DRM_CANVAS");
-   canvas.cd(1);
-   mc_data->Draw(">>merit_event_list", filter.c_str());
-   TEventList * event_list = (TEventList *)gDirectory->Get("merit_event_list");
+void MCResponse::logFill(const DrmFiller & filler,
+                         const std::vector<std::string> & meritFiles,
+                         const DrmAccumulator & DRM) const {
+   st_stream::StreamFormatter formatter("MCResponse", "ingestMeritData", 2);
+   const std::vector<DrmFiller::JobInfo> & jobs(filler.jobs());
+   for (size_t i(0); i < jobs.size(); i++) {
+      double dt = jobs[i].stop - jobs[i].start;
+      std::ostringstream tbounds;
+      tbounds << std::setprecision(14) 
+              << "start: " << jobs[i].start << "\n"
+              << "stop: " << jobs[i].stop << "\n";
+      formatter.info(3) << meritFiles[i] << ": " << jobs[i].generated << "\n"
+                        << tbounds.str() 
+                        << "flux: " << jobs[i].generated/dt/m_area 
+                        << std::endl;
+   }
+   if (filler.ncached() > 0) {
+      formatter.info() << "Cached DRM contributions used for " 
+                       << filler.ncached() << " of " << jobs.size() 
+                       << " merit files" << std::endl;
+   }
+   formatter.info() << "Total number of MC-generated events: " 
+                    << DRM.ngenerated() << std::endl;
    formatter.info() << "Number of events in the input merit files: " 
-                    << mc_data->GetEntries() << std::endl;
+                    << DRM.nread() << std::endl;
    formatter.info() << "Number of events passing cuts: " 
-                    << event_list->GetN() << std::endl;
-                    
-
-   std::ostringstream DRM_directive;
-   DRM_directive << "log10(" << efield << "):McLogEnergy>>DRM";
-   mc_data->Draw(DRM_directive.str().c_str(), filter.c_str(), "colz");
+                    << DRM.naccepted() << std::endl;
+   if (DRM.naccepted() > 0) {
+      formatter.info(3) << std::setprecision(14)
+                        << "Time range of accepted events: "
+                        << DRM.tmin() << " to " << DRM.tmax() << std::endl;
+   }
+}
 
+void MCResponse::setResponses(const DrmAccumulator & DRM) {
+   st_stream::StreamFormatter formatter("MCResponse", "setResponses", 2);
+   long ngenerated(DRM.ngenerated());
+   m_nmeas = DRM.nmeas();
+   m_values.clear();
+   m_offsets.clear();
+   m_firsts.clear();
+   m_sizes.clear();
    for (size_t k(0); k < m_nmc; k++) {
       double norm = m_area/static_cast<double>(ngenerated)/energyBinScale(k);
       formatter.info(4) << k << "  "
                         << norm << std::endl;
-      std::vector<double> row;
-      for (size_t kmeas(0); kmeas < nmeas; kmeas++) {
+      size_t first(m_nmeas), last(0);
+      for (size_t kmeas(0); kmeas < m_nmeas; kmeas++) {
          formatter.info(4) << kmeas << "  " 
-                           << DRM.GetBinContent(k+1, kmeas+1) << "  ";
-         row.push_back(norm*DRM.GetBinContent(k+1, kmeas+1));
-         formatter.info(4) << row.back() << std::endl;
+                           << DRM.binContent(k, kmeas) << "  "
+                           << norm*DRM.binContent(k, kmeas) << std::endl;
+         if (DRM.binContent(k, kmeas) != 0) {
+            first = std::min(first, kmeas);
+            last = kmeas;
+         }
+      }
+      m_offsets.push_back(m_values.size());
+      if (first == m_nmeas) {
+         m_firsts.push_back(0);
+         m_sizes.push_back(0);
+         continue;
+      }
+      m_firsts.push_back(first);
+      m_sizes.push_back(last - first + 1);
+      for (size_t kmeas(first); kmeas <= last; kmeas++) {
+         m_values.push_back(norm*DRM.binContent(k, kmeas));
       }
-      m_responses.push_back(row);
    }
-
-   delete mc_data;
 }
 
 double MCResponse::energyBinScale(size_t k) const {
@@ -153,8 +252,21 @@ double MCResponse::energyBinScale(size_t k) const {
               - std::pow(m_emin_mc, 1 + m_index)) );
 }
 
+const std::string & MCResponse::irfsName() {
+   static std::string irfs_name("P7SOURCE_V6::FRONT");
+   return irfs_name;
+}
+
 void MCResponse::setArea(double area) {
    m_area = area;
 }
 
+void MCResponse::setNumThreads(int nthreads, bool deterministic) {
+   m_filler.setNumThreads(nthreads, deterministic);
+}
+
+void MCResponse::setCacheDir(const std::string & cachedir) {
+   m_filler.setCacheDir(cachedir);
+}
+
 } //namespace fitsGenApps
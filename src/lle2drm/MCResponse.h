@@ -14,6 +14,8 @@
 
 #include "rspgen/IResponse.h"
 
+#include "DrmFiller.h"
+
 namespace evtbin {
    class Binner;
 }
@@ -24,6 +26,41 @@ class MCResponse : public rspgen::IResponse {
 
 public:
 
+   /**
+    * @class Row
+    * @brief Read-only view of one true-energy row of the response.
+    * Only the band between the first and last non-zero measured
+    * energy bins is stored; elements outside it are zero.
+    */
+   class Row {
+   public:
+      Row(const double * values, size_t first, size_t size, size_t nmeas)
+         : m_values(values), m_first(first), m_size(size), m_nmeas(nmeas) {}
+      double operator[](size_t kmeas) const {
+         return (kmeas >= m_first && kmeas < m_first + m_size) ?
+            m_values[kmeas - m_first] : 0;
+      }
+      /// Stored values, starting at measured energy bin first().
+      const double * values() const {
+         return m_values;
+      }
+      size_t first() const {
+         return m_first;
+      }
+      size_t size() const {
+         return m_size;
+      }
+      /// Number of measured energy bins.
+      size_t nmeas() const {
+         return m_nmeas;
+      }
+   private:
+      const double * m_values;
+      size_t m_first;
+      size_t m_size;
+      size_t m_nmeas;
+   };
+
    MCResponse(const std::string & spec_file,
               const evtbin::Binner * true_en_binner,
               double index=-1.,
@@ -33,13 +70,61 @@ public:
 
    virtual void compute(double true_energy, std::vector<double> & response);
 
+   /// The response row for a true energy, without copying.  The view
+   /// is valid until the response is reset.
+   Row row(double true_energy) const;
+
    void ingestMeritData(const std::vector<std::string> & meritFiles,
                         const std::string & filter,
                         double tmin=0, double tmax=0,
                         const std::string & efield="EvtEnergyCorr");
 
+   /// Ingest the merit files in a random order, nfiles at a time.
+   /// After each batch, write the response so far to a checkpoint
+   /// file derived from outfile and report its statistical error.
+   /// Stop early once the mean relative error of the bins,
+   /// DrmAccumulator::meanRelativeError(), is at most precision.
+   void ingestProgressively(const std::vector<std::string> & meritFiles,
+                            const std::string & filter,
+                            const std::string & efield,
+                            size_t nfiles, double precision,
+                            unsigned int seed,
+                            const std::string & outfile,
+                            const std::string & resp_tpl);
+
+   /// An empty accumulator with the true and measured energy binning
+   /// of this response.
+   DrmAccumulator accumulator() const;
+
+   /// Set the response by rebinning a finer-grained accumulator, such
+   /// as a master DRM, onto the binning of this response.
+   void rebinResponses(const DrmAccumulator & master);
+
+   /// Normalize the accumulated counts to effective area and set the
+   /// response matrix.
+   void setResponses(const DrmAccumulator & drm);
+
+   /// Report the jobinfo and event tallies from a fill.
+   void logFill(const DrmFiller & filler,
+                const std::vector<std::string> & meritFiles,
+                const DrmAccumulator & drm) const;
+
    void setArea(double area);
 
+   /// IRFs used to construct the rspgen::IResponse base class.  These
+   /// are never evaluated, but must have been loaded.
+   static const std::string & irfsName();
+
+   /// Fill the DRM using nthreads threads, each with its own
+   /// accumulator.  If deterministic is true, the merit files are
+   /// assigned to threads in fixed blocks so that the reduction does
+   /// not depend on thread scheduling.
+   void setNumThreads(int nthreads, bool deterministic=false);
+
+   /// Read and store per-merit-file DRM contributions in cachedir.
+   /// An empty string or "none" disables the cache.
+   void setCacheDir(const std::string & cachedir);
+
 private:
 
    long m_nmc;
@@ -48,10 +133,23 @@ private:
    double m_index;
    double m_area;
 
-   std::vector< std::vector<double> > m_responses;
+   DrmFiller m_filler;
+
+/// Banded storage of the response: row k holds m_sizes[k] values,
+/// starting at m_values[m_offsets[k]], for measured energy bins
+/// m_firsts[k] onwards.
+   size_t m_nmeas;
+   std::vector<double> m_values;
+   std::vector<size_t> m_offsets;
+   std::vector<size_t> m_firsts;
+   std::vector<size_t> m_sizes;
 
    double energyBinScale(size_t k) const;
 
+   /// outfile with "_ckpt<checkpoint>" inserted before the extension.
+   static std::string checkpointName(const std::string & outfile,
+                                     size_t checkpoint);
+
 };
 
 } // namespace fitsGenApps
@@ -0,0 +1,70 @@
+/**
+ * @file SourceCut.cxx
+ * @brief PSF and time-window selection for an LLE source, evaluated
+ * natively rather than via a ROOT filter string.
+ *
+ * @author J. Chiang
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "SourceCut.h"
+
+namespace fitsGenApps {
+
+SourceCut::SourceCut(double ra, double dec, double theta, 
+                     double tmin, double tmax) 
+   : m_ra(ra), m_dec(dec), m_theta(theta), m_tmin(tmin), m_tmax(tmax) {
+   if (theta > 40.) {
+      m_Eb = 100.;
+      m_Nb = 10.5;
+      m_low_sl = -0.65;
+      m_hi_sl = -0.81;
+   } else {
+      m_Eb = 59.;
+      m_Nb = 11.5;
+      m_low_sl = -0.55;
+      m_hi_sl = -0.87;
+   }
+}
+
+bool SourceCut::operator()(const MeritEvent & event) const {
+   if (event.time < m_tmin || event.time > m_tmax) {
+      return false;
+   }
+   double psf_radius = radius(event.energy);
+   double dra = std::cos(event.dec*0.0174533)*(event.ra - m_ra);
+   double ddec = event.dec - m_dec;
+   return dra*dra + ddec*ddec < psf_radius*psf_radius;
+}
+
+double SourceCut::radius(double energy) const {
+   return m_Nb*std::min(std::pow(energy/m_Eb, m_low_sl),
+                        std::pow(energy/m_Eb, m_hi_sl));
+}
+
+std::string SourceCut::description() const {
+   return filterString();
+}
+
+std::string SourceCut::filterString() const {
+   std::ostringstream radius;
+   radius << "(" << m_Nb << "*min(pow(EvtEnergyCorr/" << m_Eb << ", " 
+          << m_low_sl << "), pow(EvtEnergyCorr/" << m_Eb << ", " 
+          << m_hi_sl << ")))";
+   std::ostringstream cut;
+   cut << "(((cos(FT1Dec*0.0174533)*(FT1Ra - ("
+       << m_ra << ")))^2 + (FT1Dec- (" 
+       << m_dec << "))^2)< ("
+       << radius.str() << ")^2)";
+   cut << std::setprecision(14)
+       << " && ((EvtElapsedTime >= " << m_tmin << ") && "
+       << "(EvtElapsedTime <= " << m_tmax << "))";
+   return cut.str();
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,58 @@
+/**
+ * @file SourceCut.h
+ * @brief PSF and time-window selection for an LLE source, evaluated
+ * natively rather than via a ROOT filter string.
+ *
+ * @author J. Chiang
+ */
+
+#ifndef fitsGenApps_SourceCut_h
+#define fitsGenApps_SourceCut_h
+
+#include <string>
+
+#include "DrmAccumulator.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class SourceCut
+ * @brief Same selection as the PSF and time cuts that lle2drm adds to
+ * the filter string for a single source.  The PSF radius model
+ * depends on whether the off-axis angle exceeds 40 degrees.
+ */
+
+class SourceCut : public EventCut {
+
+public:
+
+   SourceCut(double ra, double dec, double theta, double tmin, double tmax);
+
+   virtual bool operator()(const MeritEvent & event) const;
+
+   virtual std::string description() const;
+
+   /// PSF and time cuts as a ROOT filter string.
+   std::string filterString() const;
+
+   /// PSF cut radius (degrees) at the given energy (MeV).
+   double radius(double energy) const;
+
+private:
+
+   double m_ra;
+   double m_dec;
+   double m_theta;
+   double m_tmin;
+   double m_tmax;
+
+   double m_Eb;
+   double m_Nb;
+   double m_low_sl;
+   double m_hi_sl;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_SourceCut_h
@@ -7,12 +7,17 @@
  */
 
 #include <cctype>
+#include <cmath>
 #include <cstdlib>
 
+#include <algorithm>
+#include <fstream>
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
 
+#include <sys/time.h>
+
 #include "TH2D.h"
 #include "TChain.h"
 
@@ -36,7 +41,12 @@
 
 #include "irfLoader/Loader.h"
 
+#include "DrmCache.h"
+#include "DrmFamily.h"
+#include "DrmFiller.h"
+#include "IncidenceCut.h"
 #include "MCResponse.h"
+#include "SourceCut.h"
 
 using facilities::commonUtilities;
 
@@ -76,6 +86,27 @@ public:
 private:
    void read_tbounds();
    void buildFilterString();
+   std::string baseFilter() const;
+   void loadIrfs() const;
+   void configure(fitsGenApps::DrmFiller & filler) const;
+
+   /// Read the master DRM from masterFile or, if it does not exist,
+   /// fill it from the merit files and write it there.
+   fitsGenApps::DrmAccumulator * 
+   masterDrm(const std::string & masterFile,
+             const std::vector<std::string> & meritFiles,
+             const std::string & efield) const;
+
+   /// Interpolate the DRM for off-axis angle theta from the family of
+   /// DRMs in familyFile, creating that file first if needed.
+   fitsGenApps::DrmAccumulator * 
+   familyDrm(const std::string & familyFile,
+             const std::vector<std::string> & meritFiles,
+             const std::string & efield, double theta) const;
+
+   /// Fill DRMs for all of the sources in a list with one pass over
+   /// the MC data.
+   void runSourceList(const std::string & srclist);
 
    st_app::AppParGroup & m_pars;
 
@@ -84,10 +115,13 @@ private:
    std::string m_filter;
 
    static std::string s_cvs_id;
+   static std::string s_master_format;
 };
 
 std::string LLE2DRM::s_cvs_id("$Name$");
 
+std::string LLE2DRM::s_master_format("lle2drm master DRM 2");
+
 st_app::StAppFactory<LLE2DRM> myAppFactory("lle2drm");
 
 void LLE2DRM::banner() const {
@@ -98,6 +132,12 @@ void LLE2DRM::banner() const {
 }
 
 void LLE2DRM::run() {
+   std::string srclist = m_pars["srclist"];
+   if (srclist != "none" && srclist != "") {
+      runSourceList(srclist);
+      return;
+   }
+
    m_pars.Prompt();
    m_pars.Save();
 
@@ -105,8 +145,7 @@ void LLE2DRM::run() {
 
    buildFilterString();
 
-// Load IRFs (needed by base class of MCResponse)
-   irfLoader::Loader::go();
+   loadIrfs();
 
 // Create the MCResponse object
    std::string spec_file = m_pars["specfile"];
@@ -117,18 +156,46 @@ void LLE2DRM::run() {
    double phindex = m_pars["phindex"];
    double area = m_pars["area"];
    fitsGenApps::MCResponse drm(spec_file, &true_en_binner, phindex, area);
+   int nthreads = m_pars["nthreads"];
+   bool deterministic = m_pars["deterministic"];
+   drm.setNumThreads(nthreads, deterministic);
+   std::string cachedir = m_pars["cachedir"];
+   drm.setCacheDir(cachedir);
 
-// Ingest the merit data
+// Ingest the merit data, either directly or via a master DRM
    std::string infile = m_pars["infile"];
    std::vector<std::string> meritFiles;
    st_facilities::Util::readLines(infile, meritFiles);
-   drm.ingestMeritData(meritFiles, m_filter, m_tmin, m_tmax);
-   
-// Write the rsp file
+   std::string efield = m_pars["efield"];
    std::string outfile = m_pars["outfile"];
    std::string dataPath(st_facilities::Environment::dataPath("rspgen"));
    std::string resp_tpl(commonUtilities::joinPath(dataPath,
                                                   "LatResponseTemplate"));
+   std::string master = m_pars["master"];
+   std::string family = m_pars["drm_family"];
+   bool progressive = m_pars["progressive"];
+   if (family != "none" && family != "") {
+      double theta = m_pars["theta"];
+      fitsGenApps::DrmAccumulator * family_drm
+         = familyDrm(family, meritFiles, efield, theta);
+      drm.rebinResponses(*family_drm);
+      delete family_drm;
+   } else if (master != "none" && master != "") {
+      fitsGenApps::DrmAccumulator * master_drm 
+         = masterDrm(master, meritFiles, efield);
+      drm.rebinResponses(*master_drm);
+      delete master_drm;
+   } else if (progressive) {
+      long nfiles = m_pars["checkpoint_files"];
+      double precision = m_pars["precision"];
+      int seed = m_pars["seed"];
+      drm.ingestProgressively(meritFiles, m_filter, efield, nfiles,
+                              precision, seed, outfile, resp_tpl);
+   } else {
+      drm.ingestMeritData(meritFiles, m_filter, m_tmin, m_tmax, efield);
+   }
+   
+// Write the rsp file
    drm.writeOutput("lle2drm", outfile, resp_tpl);
 }
 
@@ -140,48 +207,314 @@ void LLE2DRM::read_tbounds() {
    delete spectrum;
 }
 
-void LLE2DRM::buildFilterString() {
+void LLE2DRM::runSourceList(const std::string & srclist) {
+   m_pars.Prompt("infile");
+   m_pars.Prompt("zmax");
+   m_pars.Save();
+
+   st_stream::StreamFormatter formatter("LLE2DRM", "runSourceList", 2);
+
+// Each entry is "ra dec theta tmin tmax specfile outfile".
+   std::vector<std::string> lines;
+   st_facilities::Util::readLines(srclist, lines, "#", true);
+   std::vector<fitsGenApps::SourceCut> sources;
+   std::vector<std::string> specfiles;
+   std::vector<std::string> outfiles;
+   for (size_t i(0); i < lines.size(); i++) {
+      std::vector<std::string> tokens;
+      facilities::Util::stringTokenize(lines[i], " \t", tokens);
+      if (tokens.size() != 7) {
+         throw std::runtime_error("lle2drm: invalid source list entry: "
+                                  + lines[i]);
+      }
+      sources.push_back(
+         fitsGenApps::SourceCut(std::atof(tokens[0].c_str()),
+                                std::atof(tokens[1].c_str()),
+                                std::atof(tokens[2].c_str()),
+                                std::atof(tokens[3].c_str()),
+                                std::atof(tokens[4].c_str())));
+      specfiles.push_back(tokens[5]);
+      outfiles.push_back(tokens[6]);
+   }
+
+   m_filter = baseFilter();
+   formatter.info() << "Applying TCut: " << m_filter << "\n" 
+                    << "with PSF and time cuts for " << sources.size()
+                    << " sources" << std::endl;
+
+   loadIrfs();
+
+   double emin = m_pars["emin"];
+   double emax = m_pars["emax"];
+   long nmc = m_pars["enumbins"];
+   evtbin::LogBinner true_en_binner(emin, emax, nmc, "true energies");
+   double phindex = m_pars["phindex"];
+   double area = m_pars["area"];
+
+   std::vector<fitsGenApps::MCResponse *> responses;
+   std::vector<fitsGenApps::DrmAccumulator> drms;
+   std::vector<const fitsGenApps::EventCut *> cuts;
+   for (size_t j(0); j < sources.size(); j++) {
+      responses.push_back(new fitsGenApps::MCResponse(specfiles[j], 
+                                                      &true_en_binner,
+                                                      phindex, area));
+      drms.push_back(responses.back()->accumulator());
+      cuts.push_back(&sources[j]);
+   }
+
+   std::string infile = m_pars["infile"];
+   std::vector<std::string> meritFiles;
+   st_facilities::Util::readLines(infile, meritFiles);
+   std::string efield = m_pars["efield"];
+   fitsGenApps::DrmFiller filler;
+   configure(filler);
+   filler.fill(meritFiles, m_filter, efield, drms, cuts);
+
+   std::string dataPath(st_facilities::Environment::dataPath("rspgen"));
+   std::string resp_tpl(commonUtilities::joinPath(dataPath,
+                                                  "LatResponseTemplate"));
+   for (size_t j(0); j < responses.size(); j++) {
+      formatter.info() << outfiles[j] << ": " << drms[j].naccepted() 
+                       << " events passing cuts" << std::endl;
+      responses[j]->setResponses(drms[j]);
+      responses[j]->writeOutput("lle2drm", outfiles[j], resp_tpl);
+      delete responses[j];
+   }
+}
+
+void LLE2DRM::configure(fitsGenApps::DrmFiller & filler) const {
+   int nthreads = m_pars["nthreads"];
+   bool deterministic = m_pars["deterministic"];
+   std::string cachedir = m_pars["cachedir"];
+   filler.setNumThreads(nthreads, deterministic);
+   filler.setCacheDir(cachedir);
+}
+
+fitsGenApps::DrmAccumulator * 
+LLE2DRM::masterDrm(const std::string & masterFile,
+                   const std::vector<std::string> & meritFiles,
+                   const std::string & efield) const {
+   st_stream::StreamFormatter formatter("LLE2DRM", "masterDrm", 2);
+   double emin = m_pars["emin"];
+   double emax = m_pars["emax"];
+   long nbins = m_pars["master_nbins"];
+   double emeas_min = m_pars["master_emeas_min"];
+   double emeas_max = m_pars["master_emeas_max"];
+   std::vector<fitsGenApps::DrmAccumulator> 
+      drms(1, fitsGenApps::DrmAccumulator(nbins, std::log10(emin),
+                                          std::log10(emax), nbins, 
+                                          std::log10(emeas_min),
+                                          std::log10(emeas_max)));
+   std::ostringstream binning;
+   drms.front().writeBinning(binning);
+   std::string inputs(fitsGenApps::DrmCache::listFingerprint(meritFiles));
+
+// The master file records the format, the cuts and energy field, the
+// binning and a fingerprint of the merit files it was made from,
+// followed by the accumulator contents.  It is only reused if all of
+// these match the current parameters.
+   std::ifstream input(masterFile.c_str());
+   if (input) {
+      std::vector<std::string> header(5);
+      for (size_t i(0); i < header.size(); i++) {
+         std::getline(input, header[i]);
+      }
+      std::string mismatch;
+      if (header[0] != s_master_format) {
+         mismatch = "is not in the current master DRM format";
+      } else if (header[1] != m_filter || header[2] != efield) {
+         mismatch = "was made with different cuts: " + header[1] 
+            + " " + header[2];
+      } else if (header[3] != binning.str()) {
+         mismatch = "has a different binning (emin, emax, master_nbins, "
+            "master_emeas_min, master_emeas_max): " + header[3];
+      } else if (header[4] != inputs) {
+         mismatch = "was made from a different set of merit files";
+      }
+      if (mismatch != "") {
+         throw std::runtime_error("lle2drm: master DRM " + masterFile + " "
+                                  + mismatch + "; remove it or choose "
+                                  + "another master file.");
+      }
+      formatter.info() << "Using master DRM " << masterFile << std::endl;
+      return new fitsGenApps::DrmAccumulator(input);
+   }
+
+   fitsGenApps::DrmFiller filler;
+   configure(filler);
+   filler.fill(meritFiles, m_filter, efield, drms);
+
+   std::ofstream output(masterFile.c_str());
+   output << s_master_format << "\n" << m_filter << "\n" << efield << "\n"
+          << binning.str() << "\n" << inputs << "\n";
+   drms.front().write(output);
+   output.close();
+   if (!output) {
+      throw std::runtime_error("lle2drm: cannot write master DRM "
+                               + masterFile);
+   }
+   formatter.info() << "Wrote master DRM " << masterFile << std::endl;
+   return new fitsGenApps::DrmAccumulator(drms.front());
+}
+
+fitsGenApps::DrmAccumulator * 
+LLE2DRM::familyDrm(const std::string & familyFile,
+                   const std::vector<std::string> & meritFiles,
+                   const std::string & efield, double theta) const {
+   st_stream::StreamFormatter formatter("LLE2DRM", "familyDrm", 2);
+// The PSF cut of each node is applied in the instrument frame, so the
+// source position and spectrum time range are not part of the cuts.
+   std::string filter(baseFilter());
+   std::string grid = m_pars["theta_grid"];
+   std::vector<std::string> tokens;
+   facilities::Util::stringTokenize(grid, ", ", tokens);
+   std::vector<double> thetas;
+   for (size_t i(0); i < tokens.size(); i++) {
+      thetas.push_back(std::atof(tokens[i].c_str()));
+   }
+   std::sort(thetas.begin(), thetas.end());
+   if (thetas.empty()) {
+      throw std::runtime_error("lle2drm: empty theta_grid");
+   }
+   std::ostringstream theta_grid;
+   theta_grid << std::setprecision(17);
+   for (size_t i(0); i < thetas.size(); i++) {
+      theta_grid << (i > 0 ? "," : "") << thetas[i];
+   }
+   double costheta_min = m_pars["mc_costheta_min"];
+   double theta_limit(std::acos(costheta_min)*180./M_PI);
+
+   double emin = m_pars["emin"];
+   double emax = m_pars["emax"];
+   long nbins = m_pars["master_nbins"];
+   double emeas_min = m_pars["master_emeas_min"];
+   double emeas_max = m_pars["master_emeas_max"];
+   fitsGenApps::DrmAccumulator prototype(nbins, std::log10(emin),
+                                         std::log10(emax), nbins, 
+                                         std::log10(emeas_min),
+                                         std::log10(emeas_max));
+   std::ostringstream binning;
+   prototype.writeBinning(binning);
+   std::string inputs(fitsGenApps::DrmCache::listFingerprint(meritFiles));
+
+// As for the master DRM, an existing family is only reused if it was
+// made with the current cuts, binning, theta grid and merit files.
+   if (st_facilities::Util::fileExists(familyFile)) {
+      fitsGenApps::DrmFamily family(familyFile);
+      std::string mismatch;
+      if (family.binning() == "") {
+         mismatch = "does not record the binning and inputs it was made from";
+      } else if (family.filter() != filter || family.efield() != efield) {
+         mismatch = "was made with different cuts: " + family.filter() 
+            + " " + family.efield();
+      } else if (family.binning() != binning.str()) {
+         mismatch = "has a different binning (emin, emax, master_nbins, "
+            "master_emeas_min, master_emeas_max): " + family.binning();
+      } else if (family.thetaGrid() != theta_grid.str()
+                 || std::fabs(family.costhetaMin() - costheta_min) > 1e-12) {
+         std::ostringstream message;
+         message << "has a different theta_grid or mc_costheta_min: "
+                 << family.thetaGrid() << ", " << family.costhetaMin();
+         mismatch = message.str();
+      } else if (family.inputs() != inputs) {
+         mismatch = "was made from a different set of merit files";
+      }
+      if (mismatch != "") {
+         throw std::runtime_error("lle2drm: DRM family " + familyFile + " "
+                                  + mismatch + "; remove it or choose "
+                                  + "another DRM family file.");
+      }
+      formatter.info() << "Interpolating DRM family " << familyFile
+                       << " at theta = " << theta << std::endl;
+      return new fitsGenApps::DrmAccumulator(family.interpolate(theta));
+   }
+
+// Each node collects events with off-axis angles between the
+// midpoints to its neighbours.
+   std::vector<fitsGenApps::IncidenceCut> nodes;
+   for (size_t i(0); i < thetas.size(); i++) {
+      double theta_min(i == 0 ? 0 : (thetas[i-1] + thetas[i])/2.);
+      double theta_max(i == thetas.size() - 1 ? theta_limit 
+                       : (thetas[i] + thetas[i+1])/2.);
+      nodes.push_back(fitsGenApps::IncidenceCut(thetas[i], theta_min,
+                                                theta_max));
+   }
+   std::vector<const fitsGenApps::EventCut *> cuts;
+   for (size_t i(0); i < nodes.size(); i++) {
+      cuts.push_back(&nodes[i]);
+   }
+
+   std::vector<fitsGenApps::DrmAccumulator> drms(nodes.size(), prototype);
+   fitsGenApps::DrmFiller filler;
+   configure(filler);
+   filler.fill(meritFiles, filter, efield, drms, cuts);
+
+// Scale each node to the full generated sample so that the nodes can
+// be interpolated with a common ngenerated.
+   fitsGenApps::DrmFamily family(filter, efield, binning.str(), 
+                                 theta_grid.str(), costheta_min, inputs);
+   for (size_t i(0); i < nodes.size(); i++) {
+      double fraction(nodes[i].generatedFraction(costheta_min));
+      if (fraction > 0) {
+         drms[i].scale(1./fraction);
+      }
+      formatter.info() << "theta = " << nodes[i].theta() << ": "
+                       << drms[i].naccepted() << " events" << std::endl;
+      family.addNode(nodes[i].theta(), nodes[i].theta_min(), 
+                     nodes[i].theta_max(), drms[i]);
+   }
+   family.write(familyFile);
+   formatter.info() << "Wrote DRM family " << familyFile << std::endl;
+   return new fitsGenApps::DrmAccumulator(family.interpolate(theta));
+}
+
+void LLE2DRM::loadIrfs() const {
+// MCResponse never evaluates IRFs, but its rspgen::IResponse base
+// class is constructed from a named IRF, so load only the family that
+// provides it.  Loader::go selects event classes, so the event type
+// suffix ("::FRONT") is removed.
+   const std::string & irfsName(fitsGenApps::MCResponse::irfsName());
+   std::string eventClass(irfsName.substr(0, irfsName.find("::")));
+   timeval start, stop;
+   gettimeofday(&start, 0);
+   irfLoader::Loader::go(eventClass);
+   gettimeofday(&stop, 0);
+   st_stream::StreamFormatter formatter("LLE2DRM", "loadIrfs", 2);
+   formatter.info(3) << "Loading " << eventClass
+                     << " took " 
+                     << (stop.tv_sec - start.tv_sec) 
+                        + (stop.tv_usec - start.tv_usec)*1e-6
+                     << " s" << std::endl;
+}
+
+std::string LLE2DRM::baseFilter() const {
    std::string newFilter = m_pars["TCuts"];
    ::toLower(newFilter);
+   std::string filter;
    if (newFilter == "none" || newFilter == "") {
       // Standard filter string for LLE, allowing for non-default option.
-      m_filter = std::string("(ObfGamState==0) && (TkrNumTracks>0) && " 
-                             "(GltGemEngine==6 || GltGemEngine==7) && "
-                             "(EvtEnergyCorr>0)");
+      filter = std::string("(ObfGamState==0) && (TkrNumTracks>0) && " 
+                           "(GltGemEngine==6 || GltGemEngine==7) && "
+                           "(EvtEnergyCorr>0)");
    } else {
-      m_filter = newFilter;
+      filter = newFilter;
    }
 
 // Zenith angle cut
    double zmax = m_pars["zmax"];
    std::ostringstream zenithCut;
    zenithCut << "(FT1ZenithTheta < " << zmax << ")";
-   m_filter += " && " + zenithCut.str();
+   filter += " && " + zenithCut.str();
+   return filter;
+}
 
-// PSF cut
+void LLE2DRM::buildFilterString() {
+// PSF and time cuts
    double ra = m_pars["ra"];
    double dec = m_pars["dec"];
    double theta = m_pars["theta"];
-   std::string radius("(11.5*min(pow(EvtEnergyCorr/59., -0.55), "
-                      "pow(EvtEnergyCorr/59.,  -0.87)))");
-   if (theta > 40.) {
-      radius = std::string("(10.5*min(pow(EvtEnergyCorr/100., -0.65), "
-                           "pow(EvtEnergyCorr/100., -0.81)))");
-   }
-   std::ostringstream psfCut;
-   psfCut << "(((cos(FT1Dec*0.0174533)*(FT1Ra - ("
-          << ra << ")))^2 + (FT1Dec- (" 
-          << dec << "))^2)< ("
-          << radius << ")^2)";
-   m_filter += " && " + psfCut.str();
-
-
-// Time cut
-   std::ostringstream timeCut;
-   timeCut << std::setprecision(14)
-           << "((EvtElapsedTime >= " << m_tmin << ") && "
-           << "(EvtElapsedTime <= " << m_tmax << "))";
-   m_filter += "&& " + timeCut.str();
+   fitsGenApps::SourceCut sourceCut(ra, dec, theta, m_tmin, m_tmax);
+   m_filter = baseFilter() + " && " + sourceCut.filterString();
 
    st_stream::StreamFormatter formatter("LLE2DRM", "run", 2);
    formatter.info() << "Applying TCut: " << m_filter << "\n" << std::endl;
@@ -0,0 +1,76 @@
+/**
+ * @file PointingDecimator.cxx
+ * @brief Merge consecutive pointing intervals over which the attitude
+ * and zenith are nearly constant.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+
+#include "common/SkyGeometry.h"
+
+#include "PointingDecimator.h"
+
+namespace {
+/// Intervals starting this much (s) after the end of the previous one
+/// are still taken to be contiguous with it.
+   const double time_tolerance(1e-6);
+
+/// Largest of the z-axis, x-axis and zenith changes (deg) between two
+/// rows.
+   double pointingChange(const fitsGenApps::PointingRow & row1,
+                         const fitsGenApps::PointingRow & row2) {
+      using fitsGenApps::SkyGeometry;
+      return std::max(std::max(SkyGeometry::separation(row1.ra_scz,
+                                                       row1.dec_scz,
+                                                       row2.ra_scz,
+                                                       row2.dec_scz),
+                               SkyGeometry::separation(row1.ra_scx,
+                                                       row1.dec_scx,
+                                                       row2.ra_scx,
+                                                       row2.dec_scx)),
+                      SkyGeometry::separation(row1.ra_zenith,
+                                              row1.dec_zenith,
+                                              row2.ra_zenith,
+                                              row2.dec_zenith));
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+PointingDecimator::PointingDecimator(PointingMerger & input, double tolerance)
+   : m_input(input), m_tolerance(tolerance), m_have_next(false),
+     m_ninput(0), m_noutput(0), m_max_error(0) {}
+
+bool PointingDecimator::next(PointingRow & row) {
+   if (!m_have_next) {
+      if (!m_input.next(m_next)) {
+         return false;
+      }
+      m_ninput++;
+   }
+   row = m_next;
+   m_have_next = false;
+   m_noutput++;
+   if (m_tolerance <= 0) {
+      return true;
+   }
+   while (m_input.next(m_next)) {
+      m_ninput++;
+      double error(pointingChange(row, m_next));
+      if (error > m_tolerance || m_next.in_saa != row.in_saa
+          || m_next.start > row.stop + time_tolerance) {
+         m_have_next = true;
+         break;
+      }
+      row.stop = m_next.stop;
+      row.livetime += m_next.livetime;
+      m_max_error = std::max(m_max_error, error);
+   }
+   return true;
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,78 @@
+/**
+ * @file PointingDecimator.h
+ * @brief Merge consecutive pointing intervals over which the attitude
+ * and zenith are nearly constant.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_PointingDecimator_h
+#define fitsGenApps_PointingDecimator_h
+
+#include "PointingMerger.h"
+
+namespace fitsGenApps {
+
+/**
+ * @class PointingDecimator
+ * @brief Reduce the number of FT2 rows by merging runs of contiguous
+ * intervals whose z- and x-axis and zenith directions stay within a
+ * tolerance of those of the first interval in the run.  A merged row
+ * keeps the attitude, position, and other quantities of its first
+ * interval, spans the whole run, and has the summed livetime.  Runs
+ * do not bridge gaps or changes in the SAA flag.
+ *
+ * The zenith limit matters in pointed mode, when the attitude is
+ * nearly fixed but the zenith moves by about 4 deg/min; it also
+ * bounds the change in the spacecraft position, and hence in the
+ * geographic and geomagnetic quantities, within a merged row.
+ */
+
+class PointingDecimator {
+
+public:
+
+   /// @param input Source of the time-ordered rows
+   /// @param tolerance Maximum attitude or zenith change (deg) within
+   ///        a merged row; rows are passed through unchanged if
+   ///        tolerance <= 0.
+   PointingDecimator(PointingMerger & input, double tolerance);
+
+   /// Get the next, possibly merged, row.
+   /// @return false when the input is exhausted.
+   bool next(PointingRow & row);
+
+   long ninput() const {
+      return m_ninput;
+   }
+
+   long noutput() const {
+      return m_noutput;
+   }
+
+   /// Largest angle (deg) between the z-axis, x-axis or zenith of a
+   /// merged row and that of any interval it replaced.
+   double maxError() const {
+      return m_max_error;
+   }
+
+private:
+
+   PointingMerger & m_input;
+   double m_tolerance;
+
+/// Lookahead row that ended the previous run
+   PointingRow m_next;
+   bool m_have_next;
+
+   long m_ninput;
+   long m_noutput;
+   double m_max_error;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_PointingDecimator_h
@@ -0,0 +1,105 @@
+/**
+ * @file PointingMerger.cxx
+ * @brief Merge the pointing_history trees of several files into a
+ * single time-ordered sequence of rows.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <functional>
+#include <stdexcept>
+
+#include "fitsGen/MeritFile.h"
+
+#include "PointingMerger.h"
+
+namespace {
+/// Rows starting this much (s) before the previous stop are still
+/// taken to be contiguous with it.
+   const double time_tolerance(1e-6);
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+void PointingRow::read(fitsGen::MeritFile & pointing) {
+   start = pointing["start"];
+   stop = pointing["stop"];
+   std::vector<float> scPosition;
+   pointing.row()["sc_position"].get(scPosition);
+   sc_x = scPosition.at(0);
+   sc_y = scPosition.at(1);
+   sc_z = scPosition.at(2);
+   lat_geo = pointing["lat_geo"];
+   lon_geo = pointing["lon_geo"];
+   rad_geo = pointing["rad_geo"];
+   ra_zenith = pointing["ra_zenith"];
+   dec_zenith = pointing["dec_zenith"];
+   b_mcilwain = pointing["B_McIlwain"];
+   l_mcilwain = pointing["L_McIlwain"];
+   in_saa = static_cast<bool>(pointing["in_saa"]);
+   ra_scz = pointing["ra_scz"];
+   dec_scz = pointing["dec_scz"];
+   ra_scx = pointing["ra_scx"];
+   dec_scx = pointing["dec_scx"];
+   livetime = pointing["livetime"];
+   met = (start + stop)/2.;
+}
+
+PointingMerger::PointingMerger(const std::vector<std::string> & rootFiles)
+   : m_current(rootFiles.size()), m_nrows(0), m_noverlaps(0),
+     m_first(true), m_last_stop(0) {
+   for (size_t i(0); i < rootFiles.size(); i++) {
+      m_files.push_back(new fitsGen::MeritFile(rootFiles[i],
+                                               "pointing_history"));
+      m_nrows += m_files.back()->nrows();
+      if (m_files.back()->nrows() > 0) {
+         m_current[i].read(*m_files.back());
+         m_queue.push(Entry_t(m_current[i].start, i));
+      }
+   }
+}
+
+PointingMerger::~PointingMerger() throw() {
+   for (size_t i(0); i < m_files.size(); i++) {
+      delete m_files[i];
+   }
+}
+
+bool PointingMerger::next(PointingRow & row) {
+   while (!m_queue.empty()) {
+      size_t ifile(m_queue.top().second);
+      m_queue.pop();
+      const PointingRow & current(m_current[ifile]);
+      bool overlaps(!m_first && current.start < m_last_stop - time_tolerance);
+      if (!overlaps) {
+         row = current;
+         m_first = false;
+         m_last_stop = current.stop;
+      } else {
+         m_noverlaps++;
+      }
+      advance(ifile);
+      if (!overlaps) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void PointingMerger::advance(size_t ifile) {
+   fitsGen::MeritFile & file(*m_files[ifile]);
+   file.next();
+   if (file.itor() != file.end()) {
+      double previous_start(m_current[ifile].start);
+      m_current[ifile].read(file);
+      if (m_current[ifile].start < previous_start) {
+         throw std::runtime_error("PointingMerger: pointing_history rows "
+                                  "are not in time order.");
+      }
+      m_queue.push(Entry_t(m_current[ifile].start, ifile));
+   }
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,118 @@
+/**
+ * @file PointingMerger.h
+ * @brief Merge the pointing_history trees of several files into a
+ * single time-ordered sequence of rows.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_PointingMerger_h
+#define fitsGenApps_PointingMerger_h
+
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fitsGen {
+   class MeritFile;
+}
+
+namespace fitsGenApps {
+
+/**
+ * @class PointingRow
+ * @brief The pointing_history quantities that makeFT2 copies to FT2.
+ */
+
+struct PointingRow {
+   double start;
+   double stop;
+/// Spacecraft position in meters
+   float sc_x;
+   float sc_y;
+   float sc_z;
+   double lat_geo;
+   double lon_geo;
+/// Radial distance in km, as in the pointing_history tree
+   double rad_geo;
+   double ra_zenith;
+   double dec_zenith;
+   double b_mcilwain;
+   double l_mcilwain;
+   bool in_saa;
+   double ra_scz;
+   double dec_scz;
+   double ra_scx;
+   double dec_scx;
+   double livetime;
+/// Time at which the geomagnetic quantities are evaluated for the
+/// position, the midpoint of the original interval
+   double met;
+
+   void read(fitsGen::MeritFile & pointing);
+};
+
+/**
+ * @class PointingMerger
+ * @brief k-way merge of pointing_history trees by start time.  Only
+ * the current row of each file is held in memory.  Rows that start
+ * before the end of the previous merged row, such as the duplicated
+ * rows where chunks overlap, are dropped.
+ */
+
+class PointingMerger {
+
+public:
+
+   PointingMerger(const std::vector<std::string> & rootFiles);
+
+   ~PointingMerger() throw();
+
+   /// Get the next row in time order.
+   /// @return false when all files are exhausted.
+   bool next(PointingRow & row);
+
+   /// Drop rows that start before stop_time, e.g., those already in
+   /// an FT2 file being extended.
+   void resumeAfter(double stop_time) {
+      m_first = false;
+      m_last_stop = stop_time;
+   }
+
+   /// Total number of rows in the input files, an upper bound on the
+   /// number of merged rows.
+   long nrows() const {
+      return m_nrows;
+   }
+
+   /// Number of rows dropped so far as overlaps.
+   long noverlaps() const {
+      return m_noverlaps;
+   }
+
+private:
+
+   std::vector<fitsGen::MeritFile *> m_files;
+   std::vector<PointingRow> m_current;
+
+   typedef std::pair<double, size_t> Entry_t;
+/// Start time and file index of the current row of each file that
+/// has rows left, earliest first
+   std::priority_queue<Entry_t, std::vector<Entry_t>,
+                       std::greater<Entry_t> > m_queue;
+
+   long m_nrows;
+   long m_noverlaps;
+   bool m_first;
+   double m_last_stop;
+
+   void advance(size_t ifile);
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_PointingMerger_h
@@ -7,9 +7,14 @@
  */
 
 #include <cstdlib>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "facilities/Util.h"
 
@@ -19,10 +24,15 @@
 #include "st_app/StApp.h"
 #include "st_app/StAppFactory.h"
 
-#include "astro/EarthCoordinate.h"
+#include "st_facilities/Util.h"
 
 #include "fitsGen/Ft2File.h"
-#include "fitsGen/MeritFile.h"
+
+#include "common/Ft2Appender.h"
+#include "common/GeomagBatch.h"
+
+#include "PointingDecimator.h"
+#include "PointingMerger.h"
 
 using namespace fitsGen;
 
@@ -53,13 +63,79 @@ public:
 private:
    st_app::AppParGroup & m_pars;
    static std::string s_cvs_id;
-   double geomag_lat(const std::vector<float> & sc_pos, double met) const;
+   void writeBlock(const std::vector<fitsGenApps::PointingRow> & block,
+                   fitsGenApps::GeomagBatch & geomag,
+                   fitsGen::Ft2File & ft2);
 };
 
 std::string MakeFt2::s_cvs_id("$Name$");
 
 st_app::StAppFactory<MakeFt2> myAppFactory("makeFT2");
 
+namespace {
+/// The input is either a single ROOT file or a text file listing
+/// them, one per line.
+   void getRootFiles(const std::string & rootFile,
+                     std::vector<std::string> & rootFiles) {
+      std::ifstream input(rootFile.c_str(), std::ios::binary);
+      char magic[4] = {0, 0, 0, 0};
+      input.read(magic, 4);
+      if (std::string(magic, 4) == "root") {
+         rootFiles.push_back(rootFile);
+      } else {
+         st_facilities::Util::readLines(rootFile, rootFiles, "#", true);
+      }
+      if (rootFiles.empty()) {
+         throw std::runtime_error("No pointing history files in "
+                                  + rootFile);
+      }
+   }
+} // anonymous namespace
+
+void MakeFt2::writeBlock(const std::vector<fitsGenApps::PointingRow> & block,
+                         fitsGenApps::GeomagBatch & geomag,
+                         fitsGen::Ft2File & ft2) {
+   if (block.empty()) {
+      return;
+   }
+   std::vector<float> sc_x, sc_y, sc_z;
+   std::vector<double> met;
+   for (size_t i(0); i < block.size(); i++) {
+      sc_x.push_back(block[i].sc_x);
+      sc_y.push_back(block[i].sc_y);
+      sc_z.push_back(block[i].sc_z);
+      met.push_back(block[i].met);
+   }
+   geomag.compute(sc_x, sc_y, sc_z, met);
+   bool mcilwain = m_pars["mcilwain"];
+   for (size_t i(0); i < block.size(); i++, ft2.next()) {
+      const fitsGenApps::PointingRow & row(block[i]);
+      ft2["start"].set(row.start);
+      ft2["stop"].set(row.stop);
+      std::vector<float> scPosition(3);
+      scPosition[0] = row.sc_x;
+      scPosition[1] = row.sc_y;
+      scPosition[2] = row.sc_z;
+      ft2["sc_position"].set(scPosition);
+      ft2["lat_geo"].set(row.lat_geo);
+      ft2["lon_geo"].set(row.lon_geo);
+      ft2["rad_geo"].set(row.rad_geo*1e3); // convert to meters
+      ft2["ra_zenith"].set(row.ra_zenith);
+      ft2["dec_zenith"].set(row.dec_zenith);
+      if (mcilwain) {
+         ft2["l_mcilwain"].set(geomag.l_mcilwain()[i]);
+         ft2["b_mcilwain"].set(geomag.b_mcilwain()[i]);
+      } else {
+         ft2["b_mcilwain"].set(row.b_mcilwain);
+         ft2["l_mcilwain"].set(row.l_mcilwain);
+      }
+      ft2["geomag_lat"].set(geomag.geolat()[i]);
+      ft2["in_saa"].set(row.in_saa);
+      ft2.setScAxes(row.ra_scz, row.dec_scz, row.ra_scx, row.dec_scx);
+      ft2["livetime"].set(row.livetime);
+   }
+}
+
 void MakeFt2::banner() const {
    int verbosity = m_pars["chatter"];
    if (verbosity > 2) {
@@ -73,41 +149,88 @@ void MakeFt2::run() {
    std::string rootFile = m_pars["rootFile"];
    std::string fitsFile = m_pars["fitsFile"];
 
-   fitsGen::MeritFile pointing(rootFile, "pointing_history");
+   std::vector<std::string> rootFiles;
+   getRootFiles(rootFile, rootFiles);
+   fitsGenApps::PointingMerger pointing(rootFiles);
    if (pointing.nrows() == 0) {
       throw std::runtime_error("There are zero rows in the pointing_history "
-                               "tree of the input root file.");
+                               "trees of the input root files.");
+   }
+// In append mode, the rows after the end of the existing file are
+// written to a scratch file and then copied to it.
+   bool append = m_pars["append"];
+   fitsGenApps::Ft2Appender * appender(0);
+   if (append && st_facilities::Util::fileExists(fitsFile)) {
+      appender = new fitsGenApps::Ft2Appender(fitsFile);
+      pointing.resumeAfter(appender->stopTime());
    }
-   fitsGen::Ft2File ft2(fitsFile, pointing.nrows());
 
-   ft2.header().addHistory("Input merit file: " + rootFile);
-   for ( ; pointing.itor() != pointing.end(); pointing.next(), ft2.next()) {
-      ft2["start"].set(pointing["start"]);
-      ft2["stop"].set(pointing["stop"]);
-      std::vector<float> scPosition;
-      pointing.row()["sc_position"].get(scPosition);
-      ft2["sc_position"].set(scPosition);
-      ft2["lat_geo"].set(pointing["lat_geo"]);
-      ft2["lon_geo"].set(pointing["lon_geo"]);
-      ft2["rad_geo"].set(pointing["rad_geo"]*1e3); // convert to meters
-      ft2["ra_zenith"].set(pointing["ra_zenith"]);
-      ft2["dec_zenith"].set(pointing["dec_zenith"]);
-      ft2["b_mcilwain"].set(pointing["B_McIlwain"]);
-      ft2["l_mcilwain"].set(pointing["L_McIlwain"]);
-      double met((pointing["start"] + pointing["stop"])/2.);
-      ft2["geomag_lat"].set(geomag_lat(scPosition, met));
-      ft2["in_saa"].set(static_cast<bool>(pointing["in_saa"]));
-      ft2.setScAxes(pointing["ra_scz"], pointing["dec_scz"], 
-                    pointing["ra_scx"], pointing["dec_scx"]);
-      ft2["livetime"].set(pointing["livetime"]);
-   }
-   ft2.itor() = ft2.begin();
-   double start_time(ft2["start"].get());
-   ft2.itor() = ft2.end();
-   ft2.prev();
-   double stop_time(ft2["stop"].get());
+// Overlapping rows are dropped in the merge, so the table is trimmed
+// to the rows actually written at the end.
+   fitsGen::Ft2File ft2(appender ? appender->scratchFile() : fitsFile,
+                        pointing.nrows());
+   for (size_t i(0); i < rootFiles.size(); i++) {
+      ft2.header().addHistory("Input merit file: " + rootFiles[i]);
+   }
+
+   unsigned int nworkers = m_pars["nworkers"];
+   bool mcilwain = m_pars["mcilwain"];
+   fitsGenApps::GeomagBatch geomag(nworkers, mcilwain);
+   bool geomag_grid = m_pars["geomag_grid"];
+   if (geomag_grid) {
+      std::string grid_cache = m_pars["grid_cache"];
+      double grid_tolerance = m_pars["grid_tolerance"];
+      geomag.useGrid(grid_cache, grid_tolerance);
+   }
+
+// Rows are written in blocks so that the geomagnetic quantities can
+// be evaluated in batches without holding the whole history.
+   const size_t block_size(100000);
+   std::vector<fitsGenApps::PointingRow> block;
+   block.reserve(block_size);
+   double decimate = m_pars["decimate"];
+   fitsGenApps::PointingDecimator decimator(pointing, decimate);
+   fitsGenApps::PointingRow row;
+   long nwritten(0);
+   double start_time(0);
+   double stop_time(0);
+   while (decimator.next(row)) {
+      if (nwritten == 0 && block.empty()) {
+         start_time = row.start;
+      }
+      stop_time = row.stop;
+      block.push_back(row);
+      if (block.size() == block_size) {
+         writeBlock(block, geomag, ft2);
+         nwritten += block.size();
+         block.clear();
+      }
+   }
+   writeBlock(block, geomag, ft2);
+   nwritten += block.size();
+   ft2.setNumRows(nwritten);
    ft2.setObsTimes(start_time, stop_time);
 
+   st_stream::StreamFormatter formatter("makeFT2", "run", 2);
+   if (rootFiles.size() > 1) {
+      formatter.info() << "Merged " << nwritten << " rows from "
+                       << rootFiles.size() << " files; dropped "
+                       << pointing.noverlaps() << " overlapping rows."
+                       << std::endl;
+   }
+   if (decimate > 0) {
+      formatter.info() << "Decimation kept " << decimator.noutput()
+                       << " of " << decimator.ninput()
+                       << " rows (compression ratio "
+                       << static_cast<double>(decimator.ninput())
+                          /std::max(decimator.noutput(), 1L)
+                       << "); maximum attitude or zenith error "
+                       << decimator.maxError() << " deg." << std::endl;
+   }
+   if (geomag.gridReport() != "") {
+      formatter.info() << geomag.gridReport() << std::endl;
+   }
+
    std::ostringstream creator;
    creator << "makeFT2 " << getVersion();
    ft2.setPhduKeyword("CREATOR", creator.str());
@@ -115,11 +238,14 @@ void MakeFt2::run() {
    ft2.setPhduKeyword("VERSION", version);
    std::string filename(facilities::Util::basename(fitsFile));
    ft2.setPhduKeyword("FILENAME", filename);
-}
 
-double MakeFt2::geomag_lat(const std::vector<float> & sc_pos,
-                           double met) const {
-   CLHEP::Hep3Vector pos(sc_pos.at(0)/1e3, sc_pos.at(1)/1e3, sc_pos.at(2)/1e3);
-   astro::EarthCoordinate coord(pos, met);
-   return coord.geolat();
+   if (appender) {
+      ft2.close();
+      long nadded(appender->append());
+      formatter.info() << std::setprecision(14)
+                       << "Appended " << nadded << " rows to " << fitsFile
+                       << "; it now ends at " << appender->stopTime()
+                       << std::endl;
+      delete appender;
+   }
 }
@@ -0,0 +1,297 @@
+/**
+ * @file PointingHistory.cxx
+ * @brief Columns of an ascii pointing history and a fast parser for
+ * them.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PointingHistory.h"
+
+namespace {
+   /// Read-only memory map of a whole file.
+   class MappedFile {
+   public:
+      MappedFile(const std::string & filename) : m_data(0), m_size(0) {
+         int fd(open(filename.c_str(), O_RDONLY));
+         if (fd < 0) {
+            throw std::runtime_error("Cannot open " + filename);
+         }
+         struct stat buf;
+         if (fstat(fd, &buf) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat " + filename);
+         }
+         m_size = buf.st_size;
+         if (m_size > 0) {
+            void * addr(mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0));
+            if (addr == MAP_FAILED) {
+               close(fd);
+               throw std::runtime_error("Cannot mmap " + filename);
+            }
+            m_data = static_cast<const char *>(addr);
+            madvise(addr, m_size, MADV_SEQUENTIAL);
+         }
+         close(fd);
+      }
+      ~MappedFile() {
+         if (m_data) {
+            munmap(const_cast<char *>(m_data), m_size);
+         }
+      }
+      const char * begin() const {
+         return m_data;
+      }
+      const char * end() const {
+         return m_data + m_size;
+      }
+      size_t size() const {
+         return m_size;
+      }
+   private:
+      const char * m_data;
+      size_t m_size;
+      MappedFile(const MappedFile &);
+      MappedFile & operator=(const MappedFile &);
+   };
+
+   bool isBlank(char c) {
+      return c == ' ' || c == '\t' || c == '\r';
+   }
+
+   const size_t nfields(13);
+
+   /// Parse the first nfields numbers of the line [begin, eol), where
+   /// *eol is a newline.  Return false for a blank line.
+   bool parseLine(const char * begin, const char * eol, double * fields) {
+      const char * pos(begin);
+      for (size_t k(0); k < nfields; k++) {
+         while (pos < eol && isBlank(*pos)) {
+            pos++;
+         }
+         if (pos == eol) {
+            if (k == 0) {
+               return false;
+            }
+            throw std::runtime_error("Too few fields in pointing history "
+                                     "line: " + std::string(begin, eol));
+         }
+// Since *pos is not whitespace, strtod cannot skip ahead to the next
+// line, and a number cannot extend past the newline at eol.
+         char * stop;
+         fields[k] = std::strtod(pos, &stop);
+         if (stop == pos || (stop < eol && !isBlank(*stop))) {
+            throw std::runtime_error("Invalid field in pointing history "
+                                     "line: " + std::string(begin, eol));
+         }
+         pos = stop;
+      }
+      return true;
+   }
+
+   template <typename T>
+   void eraseRows(std::vector<T> & column, size_t first, size_t nrows) {
+      column.erase(column.begin() + first, column.begin() + first + nrows);
+   }
+} // anonymous namespace
+
+namespace fitsGenApps {
+
+void PointingHistory::read(const std::string & pointingFile,
+                           double time_offset, unsigned int nthreads) {
+   MappedFile file(pointingFile);
+   if (file.size() == 0) {
+      return;
+   }
+   if (nthreads == 0) {
+      nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+   }
+// Give each thread at least a few MB of input to be worth starting.
+   size_t min_range(4 << 20);
+   nthreads = std::min(static_cast<size_t>(nthreads),
+                       file.size()/min_range + 1);
+   if (nthreads == 1) {
+      parse(file.begin(), file.end(), time_offset);
+      return;
+   }
+
+// Split the file into ranges, moving each boundary to just past the
+// next newline.
+   std::vector<const char *> bounds(nthreads + 1, file.end());
+   bounds[0] = file.begin();
+   for (size_t k(1); k < nthreads; k++) {
+      const char * pos(std::max(file.begin() + k*file.size()/nthreads,
+                                bounds[k-1]));
+      const void * eol(std::memchr(pos, '\n', file.end() - pos));
+      bounds[k] = eol ? static_cast<const char *>(eol) + 1 : file.end();
+   }
+
+   std::vector<PointingHistory> parts(nthreads);
+   std::vector<std::string> errors(nthreads);
+   std::vector<std::thread> threads;
+   for (size_t k(0); k < nthreads; k++) {
+      threads.push_back(std::thread([&, k]() {
+               try {
+                  parts[k].parse(bounds[k], bounds[k+1], time_offset);
+               } catch (std::exception & eObj) {
+                  errors[k] = eObj.what();
+               }
+            }));
+   }
+   size_t nrows(size());
+   for (size_t k(0); k < nthreads; k++) {
+      threads[k].join();
+      nrows += parts[k].size();
+   }
+   for (size_t k(0); k < nthreads; k++) {
+      if (errors[k] != "") {
+         throw std::runtime_error(errors[k]);
+      }
+   }
+   reserve(nrows);
+   for (size_t k(0); k < nthreads; k++) {
+      append(parts[k]);
+   }
+}
+
+void PointingHistory::parse(const char * begin, const char * end,
+                            double time_offset) {
+   double fields[nfields];
+   const char * pos(begin);
+   while (pos < end) {
+      const char * eol(static_cast<const char *>
+                       (std::memchr(pos, '\n', end - pos)));
+      std::string last_line;
+      if (eol == 0) {
+// The final line has no newline, so parse a terminated copy of it.
+         last_line = std::string(pos, end) + "\n";
+         pos = last_line.c_str();
+         eol = pos + last_line.size() - 1;
+      }
+      if (parseLine(pos, eol, fields)) {
+         start.push_back(fields[0] + time_offset);
+// Convert the spacecraft position from km to meters.
+         sc_x.push_back(fields[1]*1e3);
+         sc_y.push_back(fields[2]*1e3);
+         sc_z.push_back(fields[3]*1e3);
+         ra_scz.push_back(fields[4]);
+         dec_scz.push_back(fields[5]);
+         ra_scx.push_back(fields[6]);
+         dec_scx.push_back(fields[7]);
+         ra_zenith.push_back(fields[8]);
+         dec_zenith.push_back(fields[9]);
+         lon_geo.push_back(fields[10]);
+         lat_geo.push_back(fields[11]);
+         rad_geo.push_back(fields[12]);
+      }
+      if (last_line != "") {
+         break;
+      }
+      pos = eol + 1;
+   }
+}
+
+void PointingHistory::append(const PointingHistory & other) {
+   start.insert(start.end(), other.start.begin(), other.start.end());
+   sc_x.insert(sc_x.end(), other.sc_x.begin(), other.sc_x.end());
+   sc_y.insert(sc_y.end(), other.sc_y.begin(), other.sc_y.end());
+   sc_z.insert(sc_z.end(), other.sc_z.begin(), other.sc_z.end());
+   ra_scz.insert(ra_scz.end(), other.ra_scz.begin(), other.ra_scz.end());
+   dec_scz.insert(dec_scz.end(), other.dec_scz.begin(), other.dec_scz.end());
+   ra_scx.insert(ra_scx.end(), other.ra_scx.begin(), other.ra_scx.end());
+   dec_scx.insert(dec_scx.end(), other.dec_scx.begin(), other.dec_scx.end());
+   ra_zenith.insert(ra_zenith.end(), other.ra_zenith.begin(),
+                    other.ra_zenith.end());
+   dec_zenith.insert(dec_zenith.end(), other.dec_zenith.begin(),
+                     other.dec_zenith.end());
+   lon_geo.insert(lon_geo.end(), other.lon_geo.begin(), other.lon_geo.end());
+   lat_geo.insert(lat_geo.end(), other.lat_geo.begin(), other.lat_geo.end());
+   rad_geo.insert(rad_geo.end(), other.rad_geo.begin(), other.rad_geo.end());
+}
+
+void PointingHistory::reserve(size_t nrows) {
+   start.reserve(nrows);
+   sc_x.reserve(nrows);
+   sc_y.reserve(nrows);
+   sc_z.reserve(nrows);
+   ra_scz.reserve(nrows);
+   dec_scz.reserve(nrows);
+   ra_scx.reserve(nrows);
+   dec_scx.reserve(nrows);
+   ra_zenith.reserve(nrows);
+   dec_zenith.reserve(nrows);
+   lon_geo.reserve(nrows);
+   lat_geo.reserve(nrows);
+   rad_geo.reserve(nrows);
+}
+
+void PointingHistory::dropRows(size_t nrows, size_t first) {
+   first = std::min(first, size());
+   nrows = std::min(nrows, size() - first);
+   eraseRows(start, first, nrows);
+   eraseRows(sc_x, first, nrows);
+   eraseRows(sc_y, first, nrows);
+   eraseRows(sc_z, first, nrows);
+   eraseRows(ra_scz, first, nrows);
+   eraseRows(dec_scz, first, nrows);
+   eraseRows(ra_scx, first, nrows);
+   eraseRows(dec_scx, first, nrows);
+   eraseRows(ra_zenith, first, nrows);
+   eraseRows(dec_zenith, first, nrows);
+   eraseRows(lon_geo, first, nrows);
+   eraseRows(lat_geo, first, nrows);
+   eraseRows(rad_geo, first, nrows);
+}
+
+PointingHistoryReader::PointingHistoryReader(std::istream & input,
+                                             double time_offset,
+                                             size_t buffer_size)
+   : m_input(input), m_time_offset(time_offset), 
+     m_buffer(std::max(buffer_size, size_t(1))), m_nbytes(0), m_eof(false) {}
+
+bool PointingHistoryReader::read(PointingHistory & history, size_t nrows) {
+   while (history.size() < nrows && !m_eof) {
+      if (m_nbytes == m_buffer.size()) {
+// A line longer than the buffer: make room for the rest of it.
+         m_buffer.resize(2*m_buffer.size());
+      }
+      m_input.read(&m_buffer[m_nbytes], m_buffer.size() - m_nbytes);
+      m_nbytes += m_input.gcount();
+      if (!m_input) {
+         m_eof = true;
+         history.parse(&m_buffer[0], &m_buffer[0] + m_nbytes, m_time_offset);
+         m_nbytes = 0;
+         break;
+      }
+// Parse the complete lines and keep the partial one for next time.
+      const char * begin(&m_buffer[0]);
+      const char * end(begin + m_nbytes);
+      const char * last(end);
+      while (last > begin && *(last - 1) != '\n') {
+         last--;
+      }
+      if (last == begin) {
+         continue;
+      }
+      history.parse(begin, last, m_time_offset);
+      m_nbytes = end - last;
+      std::memmove(&m_buffer[0], last, m_nbytes);
+   }
+   return !m_eof;
+}
+
+} // namespace fitsGenApps
@@ -0,0 +1,115 @@
+/**
+ * @file PointingHistory.h
+ * @brief Columns of an ascii pointing history and a fast parser for
+ * them.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#ifndef fitsGenApps_PointingHistory_h
+#define fitsGenApps_PointingHistory_h
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace fitsGenApps {
+
+/**
+ * @class PointingHistory
+ * @brief Columns of an ascii pointing history, plus the columns
+ * derived from them, held in memory so that the FT2 file can be
+ * written in a single pass.
+ */
+
+struct PointingHistory {
+
+   std::vector<double> start;
+   std::vector<double> stop;
+/// Spacecraft position in meters
+   std::vector<float> sc_x;
+   std::vector<float> sc_y;
+   std::vector<float> sc_z;
+   std::vector<double> ra_scz;
+   std::vector<double> dec_scz;
+   std::vector<double> ra_scx;
+   std::vector<double> dec_scx;
+   std::vector<double> ra_zenith;
+   std::vector<double> dec_zenith;
+   std::vector<double> lon_geo;
+   std::vector<double> lat_geo;
+   std::vector<double> rad_geo;
+   std::vector<double> rock_angle;
+   std::vector<double> ra_npole;
+   std::vector<double> dec_npole;
+   std::vector<double> geomag_lat;
+   std::vector<bool> in_saa;
+   std::vector<double> livetime;
+
+   size_t size() const {
+      return start.size();
+   }
+
+   std::vector<float> sc_position(size_t i) const {
+      std::vector<float> scPosition(3);
+      scPosition[0] = sc_x[i];
+      scPosition[1] = sc_y[i];
+      scPosition[2] = sc_z[i];
+      return scPosition;
+   }
+
+   /// Read the ascii file via mmap, splitting it at line boundaries
+   /// into ranges that are parsed on nthreads threads.  If nthreads
+   /// is zero, the number of hardware threads is used.
+   void read(const std::string & pointingFile, double time_offset,
+             unsigned int nthreads=0);
+
+   /// Parse the lines in [begin, end), appending a row for each.
+   /// Blank lines are skipped.
+   void parse(const char * begin, const char * end, double time_offset);
+
+   /// Append the input columns of other.
+   void append(const PointingHistory & other);
+
+   void reserve(size_t nrows);
+
+   /// Remove nrows rows of the input columns, starting at row first.
+   void dropRows(size_t nrows, size_t first=0);
+
+};
+
+/**
+ * @class PointingHistoryReader
+ * @brief Read an ascii pointing history incrementally from a stream,
+ * such as a pipe, in blocks of rows.
+ */
+
+class PointingHistoryReader {
+
+public:
+
+   PointingHistoryReader(std::istream & input, double time_offset,
+                         size_t buffer_size=1 << 20);
+
+   /// Append rows to history until it has at least nrows rows or the
+   /// input is exhausted.  Rows are parsed a buffer at a time, so a
+   /// few more than nrows may be appended.
+   /// @return false if the input is exhausted.
+   bool read(PointingHistory & history, size_t nrows);
+
+private:
+
+   std::istream & m_input;
+   double m_time_offset;
+   std::vector<char> m_buffer;
+/// Number of bytes at the start of m_buffer not yet parsed
+   size_t m_nbytes;
+   bool m_eof;
+
+};
+
+} // namespace fitsGenApps
+
+#endif // fitsGenApps_PointingHistory_h
@@ -10,47 +10,105 @@
 #include <cstdlib>
 
 #include <algorithm>
-#include <fstream>
 #include <functional>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
 #include "facilities/Timestamp.h"
 #include "facilities/Util.h"
 
-#include "astro/EarthCoordinate.h"
-#include "astro/SkyDir.h"
+#include "astro/JulianDate.h"
+
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
 
 #include "fitsGen/Ft2File.h"
 
+#include "common/Ft2Appender.h"
+#include "common/GeomagBatch.h"
+#include "common/SkyGeometry.h"
+
+#include "PointingHistory.h"
+
 using namespace fitsGen;
+using fitsGenApps::PointingHistory;
 
 namespace {
 
-void getFileNames(int iargc, char * argv[], std::string & rootFile,
-                  std::string & fitsFile) {
-   if (iargc != 3 && iargc != 4) {
-      std::cout << "usage: " 
-                << facilities::Util::basename(argv[0]) << " "
-                << "<pointing history file> " 
-                << "<FITS output file> [<start_date>]" << std::endl;
-      std::exit(0);
-   } else {
-      rootFile = std::string(argv[1]);
-      fitsFile = std::string(argv[2]);     
-   }
+/// Command-line options and arguments.
+struct Options {
+   Options() : streaming(false), append(false), use_grid(false),
+               grid_cache("none"), grid_tolerance(0.01) {}
+   std::string pointingFile;
+   std::string fitsFile;
+   std::string start_date;
+   bool streaming;
+   bool append;
+   bool use_grid;
+   std::string grid_cache;
+   double grid_tolerance;
+};
+
+void usage(char * argv[]) {
+   std::cout << "usage: " 
+             << facilities::Util::basename(argv[0]) << " "
+             << "[-s] [-a] [-g] [-c <grid cache file>] "
+             << "[-t <grid tolerance (deg)>] "
+             << "<pointing history file> " 
+             << "<FITS output file> [<start_date>]\n\n"
+             << "  -s  stream the input in blocks, using bounded memory;\n"
+             << "      a pointing history file of - reads standard input\n"
+             << "  -a  append the rows after the end of an existing FITS "
+             << "output file\n"
+             << "  -g  look up geomagnetic latitude and SAA flags in a grid\n"
+             << "  -c  read or write the grid in this file (implies -g)\n"
+             << "  -t  evaluate all rows exactly if the grid deviates by "
+             << "more than this\n      (default 0.01 deg); SAA features "
+             << "narrower than a grid cell\n      are not resolved" 
+             << std::endl;
+   std::exit(0);
 }
 
-unsigned long count_lines(const std::string & infile) {
-   std::ifstream file(infile.c_str());
-   unsigned long nlines(0);
-   std::string line;
-   while (std::getline(file, line, '\n')) {
-      nlines++;
+void getOptions(int iargc, char * argv[], Options & options) {
+   int opt;
+   while ((opt = getopt(iargc, argv, "sagc:t:")) != -1) {
+      switch (opt) {
+      case 's':
+         options.streaming = true;
+         break;
+      case 'a':
+         options.append = true;
+         break;
+      case 'g':
+         options.use_grid = true;
+         break;
+      case 'c':
+         options.use_grid = true;
+         options.grid_cache = optarg;
+         break;
+      case 't':
+         options.grid_tolerance = std::atof(optarg);
+         break;
+      default:
+         usage(argv);
+      }
+   }
+   int nargs(iargc - optind);
+   if (nargs != 2 && nargs != 3) {
+      usage(argv);
+   }
+   options.pointingFile = argv[optind];
+   options.fitsFile = argv[optind + 1];
+   if (nargs == 3) {
+      options.start_date = argv[optind + 2];
    }
-   file.close();
-   return nlines;
 }
 
 double startDate(const std::string & start_date) {
@@ -61,143 +119,321 @@ double startDate(const std::string & start_date) {
    return offset;
 }
 
-double geomag_lat(const std::vector<float> & sc_pos, double met) {
-   CLHEP::Hep3Vector pos(sc_pos.at(0)/1e3, sc_pos.at(1)/1e3, sc_pos.at(2)/1e3);
-   astro::EarthCoordinate coord(pos, met);
-   return coord.geolat();
+/// Read the input columns of the last row of an existing FT2 file.
+/// When the file is extended, this row is recomputed along with the
+/// new ones, since its derived columns depend on the row after it.
+void readLastRow(const std::string & fitsFile, PointingHistory & context) {
+   const tip::Table * table
+      = tip::IFileSvc::instance().readTable(fitsFile, "SC_DATA");
+   if (table->getNumRecords() > 0) {
+      tip::Table::ConstIterator it(table->end());
+      --it;
+      const tip::ConstTableRecord & row(*it);
+      context.start.push_back(row["start"].get());
+      std::vector<double> scPosition;
+      row["sc_position"].get(scPosition);
+      context.sc_x.push_back(scPosition.at(0));
+      context.sc_y.push_back(scPosition.at(1));
+      context.sc_z.push_back(scPosition.at(2));
+      context.ra_scz.push_back(row["ra_scz"].get());
+      context.dec_scz.push_back(row["dec_scz"].get());
+      context.ra_scx.push_back(row["ra_scx"].get());
+      context.dec_scx.push_back(row["dec_scx"].get());
+      context.ra_zenith.push_back(row["ra_zenith"].get());
+      context.dec_zenith.push_back(row["dec_zenith"].get());
+      context.lon_geo.push_back(row["lon_geo"].get());
+      context.lat_geo.push_back(row["lat_geo"].get());
+      context.rad_geo.push_back(row["rad_geo"].get());
+   }
+   delete table;
 }
 
-bool inside_saa(const std::vector<float> & sc_pos, double met) {
-   CLHEP::Hep3Vector pos(sc_pos.at(0)/1e3, sc_pos.at(1)/1e3, sc_pos.at(2)/1e3);
-   astro::EarthCoordinate coord(pos, met);
-   return coord.insideSAA();
+/// Remove the rows from first on that start at or before cutoff,
+/// i.e., those already in the FT2 file being extended.  Since the
+/// rows are in time order, these are the leading ones.
+void dropStaleRows(PointingHistory & history, size_t first, double cutoff) {
+// Rows starting within this much (s) of the cutoff are taken to be
+// the row at the cutoff.
+   const double time_tolerance(1e-6);
+   size_t k(first);
+   while (k < history.size() && history.start[k] < cutoff + time_tolerance) {
+      k++;
+   }
+   history.dropRows(k - first, first);
+}
+
+template <typename T>
+std::vector<T> slice(const std::vector<T> & column, size_t first, size_t last) {
+   return std::vector<T>(column.begin() + first, column.begin() + last);
+}
+
+/// Compute the columns that are not in the ascii file for rows
+/// [first, last).  Apart from the rock angle, these depend on the
+/// following row: the orbit pole is the cross product of successive
+/// positions, and each interval stops at the start of the next.  The
+/// last row of the history reuses the pole and time step of the row
+/// before it.  The geomagnetic quantities are evaluated at the
+/// interval midpoints.
+void computeDerivedColumns(PointingHistory & history, 
+                           fitsGenApps::GeomagBatch & geomag,
+                           size_t first, size_t last) {
+   size_t nrows(history.size());
+   if (nrows < 2) {
+      throw std::runtime_error("At least two rows of pointing history "
+                               "are needed.");
+   }
+   history.stop.resize(nrows);
+   history.rock_angle.resize(nrows);
+   history.ra_npole.resize(nrows);
+   history.dec_npole.resize(nrows);
+   history.geomag_lat.resize(nrows);
+   history.in_saa.resize(nrows);
+   history.livetime.resize(nrows);
+   size_t n(last - first);
+
+   fitsGenApps::UnitVectors scz, zenith;
+   fitsGenApps::SkyGeometry::unitVectors(slice(history.ra_scz, first, last),
+                                         slice(history.dec_scz, first, last),
+                                         scz);
+   fitsGenApps::SkyGeometry::
+      unitVectors(slice(history.ra_zenith, first, last),
+                  slice(history.dec_zenith, first, last), zenith);
+   std::vector<double> rock_angle;
+   fitsGenApps::SkyGeometry::separations(scz, zenith, rock_angle);
+
+   fitsGenApps::UnitVectors pos, next_pos, pole;
+   pos.resize(n);
+   next_pos.resize(n);
+   std::vector<double> met(n);
+   for (size_t i(first); i < last; i++) {
+      size_t k(i - first);
+      if (history.dec_scz[i] < history.dec_zenith[i]) {
+         rock_angle[k] *= -1.;
+      }
+      history.rock_angle[i] = rock_angle[k];
+
+      size_t j(i + 1 < nrows ? i : i - 1);
+      pos.x[k] = history.sc_x[j];
+      pos.y[k] = history.sc_y[j];
+      pos.z[k] = history.sc_z[j];
+      next_pos.x[k] = history.sc_x[j+1];
+      next_pos.y[k] = history.sc_y[j+1];
+      next_pos.z[k] = history.sc_z[j+1];
+
+      if (i + 1 < nrows) {
+         history.stop[i] = history.start[i+1];
+      } else {
+         history.stop[i] = history.start[i] 
+            + (history.start[i] - history.start[i-1]);
+      }
+      met[k] = (history.start[i] + history.stop[i])/2.;
+   }
+   fitsGenApps::SkyGeometry::cross(pos, next_pos, pole);
+   std::vector<double> ra_npole, dec_npole;
+   fitsGenApps::SkyGeometry::raDec(pole, ra_npole, dec_npole);
+   std::copy(ra_npole.begin(), ra_npole.end(), history.ra_npole.begin() + first);
+   std::copy(dec_npole.begin(), dec_npole.end(), 
+             history.dec_npole.begin() + first);
+
+   if (first == 0 && last == nrows) {
+      geomag.compute(history.sc_x, history.sc_y, history.sc_z, met);
+   } else {
+      geomag.compute(slice(history.sc_x, first, last),
+                     slice(history.sc_y, first, last),
+                     slice(history.sc_z, first, last), met);
+   }
+   for (size_t i(first); i < last; i++) {
+      history.geomag_lat[i] = geomag.geolat()[i - first];
+      history.in_saa[i] = geomag.in_saa()[i - first];
+      double full_interval(history.stop[i] - history.start[i]);
+      double fraction(0.90);
+      history.livetime[i] = history.in_saa[i] ? 0 : fraction*full_interval;
+   }
+}
+
+/// Write rows [first, last) of the history, starting at the current
+/// row of ft2.
+void writeFt2(const PointingHistory & history, fitsGen::Ft2File & ft2,
+              size_t first, size_t last) {
+   for (size_t i(first); i < last; i++, ft2.next()) {
+      ft2["start"].set(history.start[i]);
+      ft2["stop"].set(history.stop[i]);
+      ft2["sc_position"].set(history.sc_position(i));
+      ft2.setScAxes(history.ra_scz[i], history.dec_scz[i],
+                    history.ra_scx[i], history.dec_scx[i]);
+      ft2["ra_zenith"].set(history.ra_zenith[i]);
+      ft2["dec_zenith"].set(history.dec_zenith[i]);
+      ft2["lon_geo"].set(history.lon_geo[i]);
+      ft2["lat_geo"].set(history.lat_geo[i]);
+      ft2["rad_geo"].set(history.rad_geo[i]);
+      ft2["data_qual"].set(0);
+      ft2["lat_mode"].set(0);
+      ft2["lat_config"].set(0);
+      ft2["rock_angle"].set(history.rock_angle[i]);
+      ft2["ra_npole"].set(history.ra_npole[i]);
+      ft2["dec_npole"].set(history.dec_npole[i]);
+      ft2["geomag_lat"].set(history.geomag_lat[i]);
+      ft2["in_saa"].set(static_cast<bool>(history.in_saa[i]));
+      ft2["livetime"].set(history.livetime[i]);
+   }
+}
+
+/// Convert the pointing history block by block, holding only the
+/// current block of rows in memory.  Since the derived columns of a
+/// row depend on the next one, the last row read in each block is
+/// not written until the next block; the last row written is also
+/// kept as context for the final time step and orbit pole.  The
+/// output begins with the rows of context, followed by the input
+/// rows that start after cutoff.
+/// @return The number of rows written, or zero if no input rows
+///         follow the context.
+long streamFt2(std::istream & input, double time_offset,
+               fitsGenApps::GeomagBatch & geomag, fitsGen::Ft2File & ft2,
+               const PointingHistory & context, double cutoff) {
+   const size_t block_size(100000);
+   fitsGenApps::PointingHistoryReader reader(input, time_offset);
+   PointingHistory block(context);
+   size_t first(0);
+   long nwritten(0);
+   long capacity(0);
+   double tstart(0), tstop(0);
+   bool more(true);
+   while (more) {
+      size_t nold(block.size());
+      more = reader.read(block, first + block_size);
+      dropStaleRows(block, nold, cutoff);
+      if (more && block.size() < first + 2) {
+         continue;
+      }
+      if (nwritten == 0 && block.size() <= context.size()) {
+         break;
+      }
+      size_t last(more ? block.size() - 1 : block.size());
+      if (last <= first) {
+         break;
+      }
+      computeDerivedColumns(block, geomag, first, last);
+      long nrows(last - first);
+      if (nwritten + nrows > capacity) {
+// Grow the table geometrically, so that repositioning the iterator
+// after each resize costs O(1) per row overall.
+         capacity = std::max(2*capacity, nwritten + nrows);
+         ft2.setNumRows(capacity);
+         ft2.itor() = ft2.begin();
+         for (long i(0); i < nwritten; i++) {
+            ft2.next();
+         }
+      }
+      writeFt2(block, ft2, first, last);
+      if (nwritten == 0) {
+         tstart = block.start[first];
+      }
+      tstop = block.stop[last - 1];
+      nwritten += nrows;
+      block.dropRows(last - 1);
+      first = 1;
+   }
+   if (nwritten == 0) {
+      if (context.size() == 0) {
+         throw std::runtime_error("At least two rows of pointing history "
+                                  "are needed.");
+      }
+      return 0;
+   }
+   ft2.setNumRows(nwritten);
+   ft2.setObsTimes(tstart, tstop);
+   return nwritten;
 }
 
 } // unnamed namespace
 
 int main(int iargc, char * argv[]) {
    try {
-      std::string pointingFile;
-      std::string fitsFile;
-      
-      ::getFileNames(iargc, argv, pointingFile, fitsFile);
-      unsigned long nrows = ::count_lines(pointingFile);
+      ::Options options;
+      ::getOptions(iargc, argv, options);
+      const std::string & pointingFile(options.pointingFile);
+      const std::string & fitsFile(options.fitsFile);
 
       double time_offset(0);
-      if (iargc == 4) {
+      if (options.start_date != "") {
          std::cout << "Using launch date: " 
-                   << argv[3] << std::endl;
-         time_offset = ::startDate(argv[3]);
+                   << options.start_date << std::endl;
+         time_offset = ::startDate(options.start_date);
       }
 
-      fitsGen::Ft2File ft2(fitsFile, nrows);
-
-      ft2.header().addHistory("Input pointing history file: " + pointingFile);
-
-      std::ifstream d2(pointingFile.c_str());
-      std::string line;
-      std::vector<std::string> dataFields;
-      std::vector<float> scPosition(3);
-      std::vector<CLHEP::Hep3Vector> sc_pos;
-      while (std::getline(d2, line, '\n')) {
-         facilities::Util::stringTokenize(line, "\t ", dataFields);
-         ft2["start"].set(std::atof(dataFields[0].c_str()) + time_offset);
-// Convert the spacecraft position from km to meters.
-         scPosition[0] = std::atof(dataFields[1].c_str())*1e3;
-         scPosition[1] = std::atof(dataFields[2].c_str())*1e3;
-         scPosition[2] = std::atof(dataFields[3].c_str())*1e3;
-         sc_pos.push_back(CLHEP::Hep3Vector(scPosition[0], scPosition[1],
-                                            scPosition[2]));
-         ft2["sc_position"].set(scPosition);
-         double ra_scz(std::atof(dataFields[4].c_str()));
-         double dec_scz(std::atof(dataFields[5].c_str()));
-         double ra_scx(std::atof(dataFields[6].c_str()));
-         double dec_scx(std::atof(dataFields[7].c_str()));
-         ft2.setScAxes(ra_scz, dec_scz, ra_scx, dec_scx);
-         double ra_zenith(std::atof(dataFields[8].c_str()));
-         double dec_zenith(std::atof(dataFields[9].c_str()));
-         ft2["ra_zenith"].set(ra_zenith);
-         ft2["dec_zenith"].set(dec_zenith);
-         double lonGeo = std::atof(dataFields[10].c_str());
-         double latGeo = std::atof(dataFields[11].c_str());
-         double radGeo = std::atof(dataFields[12].c_str());
-         ft2["lon_geo"].set(lonGeo);
-         ft2["lat_geo"].set(latGeo);
-         ft2["rad_geo"].set(radGeo);
-         ft2["data_qual"].set(0);
-         ft2["lat_mode"].set(0);
-         ft2["lat_config"].set(0);
-         astro::SkyDir scz(ra_scz, dec_scz);
-         astro::SkyDir zenith(ra_zenith, dec_zenith);
-         double rock_angle = scz.difference(zenith)*180./M_PI;
-         if (dec_scz < dec_zenith) {
-            rock_angle *= -1.;
-         }
-         ft2["rock_angle"].set(rock_angle);
-         ft2.next();
+      fitsGenApps::GeomagBatch geomag(0);
+      if (options.use_grid) {
+         geomag.useGrid(options.grid_cache, options.grid_tolerance);
       }
 
-// Compute ra_npole, dec_npole
-      ft2.itor() = ft2.begin();
-      double ra_npole, dec_npole;
-      for (size_t i(0); i < sc_pos.size()-1; ft2.next(), i++) {
-         astro::SkyDir pole(sc_pos[i].cross(sc_pos[i+1]));
-         ra_npole = pole.ra();
-         dec_npole = pole.dec();
-         ft2["ra_npole"].set(ra_npole);
-         ft2["dec_npole"].set(dec_npole);
-      }
-      ft2["ra_npole"].set(ra_npole);
-      ft2["dec_npole"].set(dec_npole);
-
-// Get stop times. Table::Iterator does not have random access.
-// Also fill the GEOMAG_LAT and IN_SAA columns.
-      ft2.itor() = ft2.begin();
-      ft2.next();
-      double stop_time;
-      for ( ; ft2.itor() != ft2.end(); ft2.next()) {
-         stop_time = ft2["start"].get();
-         ft2.prev();
-         ft2["stop"].set(stop_time);
-         double met = (ft2["start"].get() + stop_time)/2.;
-         ft2["sc_position"].get(scPosition);
-         ft2["geomag_lat"].set(::geomag_lat(scPosition, met));
-         ft2["in_saa"].set(::inside_saa(scPosition, met));
-         ft2.next();
-      }
-      ft2.itor() = ft2.end();
-      ft2.prev();
-      ft2.prev();
-      double time_step = stop_time - ft2["start"].get();
-      ft2.next();
-      stop_time += time_step;
-      ft2["stop"].set(stop_time);
-      double met = (ft2["start"].get() + stop_time)/2.;
-      ft2["sc_position"].get(scPosition);
-      ft2["geomag_lat"].set(::geomag_lat(scPosition, met));
-      ft2["in_saa"].set(::inside_saa(scPosition, met));
-
-// Fill livetime.
-      ft2.itor() = ft2.begin();
-      for ( ; ft2.itor() != ft2.end(); ft2.next()) {
-         double full_interval(ft2["stop"].get() - ft2["start"].get());
-         double fraction(0.90);
-         ft2["livetime"].set(fraction*full_interval);
-         bool in_saa;
-         ft2["in_saa"].get(in_saa);
-         if (true == in_saa) {
-            ft2["livetime"].set(0);
+// In append mode, the last row of the existing file and the rows
+// after it are written to a scratch file, which then replaces that
+// row and extends the file.
+      fitsGenApps::Ft2Appender * appender(0);
+      PointingHistory context;
+      double cutoff(-std::numeric_limits<double>::max());
+      if (options.append && access(fitsFile.c_str(), F_OK) == 0) {
+         appender = new fitsGenApps::Ft2Appender(fitsFile);
+         ::readLastRow(fitsFile, context);
+// The STOP of the last row was extrapolated from the previous time
+// step, so a new row may start before it; the last row itself is
+// recomputed from the new rows that follow its START.
+         if (context.size() > 0) {
+            cutoff = context.start.back();
          }
       }
+      const std::string & outfile(appender ? appender->scratchFile()
+                                  : fitsFile);
+      long nrows(0);
 
-      ft2.itor() = ft2.begin();
-      double start(ft2["start"].get());
-      ft2.itor() = ft2.end();
-      ft2.prev();
-      double stop(ft2["stop"].get());
-      ft2.setObsTimes(start, stop);
+      if (options.streaming || pointingFile == "-") {
+         std::ifstream file;
+         std::istream * input(&std::cin);
+         if (pointingFile != "-") {
+            file.open(pointingFile.c_str());
+            if (!file) {
+               throw std::runtime_error("Cannot open " + pointingFile);
+            }
+            input = &file;
+         }
+         fitsGen::Ft2File ft2(outfile, 0);
+         ft2.header().addHistory("Input pointing history file: " 
+                                 + pointingFile);
+         nrows = ::streamFt2(*input, time_offset, geomag, ft2,
+                             context, cutoff);
+         ft2.setPhduKeyword("CREATOR", "makeFT2a");
+      } else {
+         PointingHistory history(context);
+         history.read(pointingFile, time_offset);
+         ::dropStaleRows(history, context.size(), cutoff);
+         if (!appender || history.size() > context.size()) {
+            ::computeDerivedColumns(history, geomag, 0, history.size());
 
-      ft2.setPhduKeyword("CREATOR", "makeFT2a");
+            fitsGen::Ft2File ft2(outfile, history.size());
+            ft2.header().addHistory("Input pointing history file: " 
+                                    + pointingFile);
+            ::writeFt2(history, ft2, 0, history.size());
+            ft2.setObsTimes(history.start.front(), history.stop.back());
+            ft2.setPhduKeyword("CREATOR", "makeFT2a");
+            nrows = history.size();
+         }
+      }
+      if (appender) {
+         if (nrows > 0) {
+            long nadded(appender->append(context.size()));
+            std::cout << std::setprecision(14)
+                      << "Appended " << nadded << " rows to " << fitsFile
+                      << "; it now ends at " << appender->stopTime()
+                      << std::endl;
+         } else {
+            std::cout << "No rows after the end of " << fitsFile 
+                      << std::endl;
+         }
+         delete appender;
+      }
+      if (geomag.gridReport() != "") {
+         std::cout << geomag.gridReport() << std::endl;
+      }
    } catch (std::exception & eObj) {
       std::cout << eObj.what() << std::endl;
       std::exit(1);
@@ -14,10 +14,19 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TChain.h"
+
+#include "facilities/commonUtilities.h"
 #include "facilities/Util.h"
 
 #include "astro/SkyDir.h"
@@ -28,6 +37,11 @@
 #include "st_app/StApp.h"
 #include "st_app/StAppFactory.h"
 
+#include "tip/Extension.h"
+#include "tip/Header.h"
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
+
 #include "dataSubselector/Gti.h"
 #include "dataSubselector/Cuts.h"
 
@@ -133,6 +147,46 @@ namespace {
          }
       }
    }
+
+   /// Merit chunks (*.root) currently present in a directory, in
+   /// lexical order.
+   void listMeritChunks(const std::string & dirname,
+                        std::vector<std::string> & chunks) {
+      chunks.clear();
+      DIR * dir = opendir(dirname.c_str());
+      if (dir == 0) {
+         throw std::runtime_error("Cannot read directory " + dirname);
+      }
+      struct dirent * entry;
+      while ((entry = readdir(dir)) != 0) {
+         std::string name(entry->d_name);
+         if (name.size() > 5 && name.substr(name.size() - 5) == ".root") {
+            chunks.push_back(facilities::commonUtilities::joinPath(dirname,
+                                                                   name));
+         }
+      }
+      closedir(dir);
+      std::sort(chunks.begin(), chunks.end());
+   }
+
+   long fileSize(const std::string & filename) {
+      struct stat buf;
+      if (stat(filename.c_str(), &buf) != 0) {
+         return -1;
+      }
+      return static_cast<long>(buf.st_size);
+   }
+
+   /// Latest event time in a merit chunk, irrespective of any cuts.
+   /// This sets how far the GTI of the LLE file can be extended once
+   /// the chunk has been ingested.
+   double chunkStopTime(const std::string & meritFile) {
+      TChain chunk("MeritTuple");
+      chunk.Add(meritFile.c_str());
+      chunk.SetBranchStatus("*", 0);
+      chunk.SetBranchStatus("EvtElapsedTime", 1);
+      return chunk.GetMaximum("EvtElapsedTime");
+   }
 } // anonymous namespace
 
 class MakeLLE : public st_app::StApp {
@@ -163,6 +217,34 @@ public:
 private:
    st_app::AppParGroup & m_pars;
    static std::string s_cvs_id;
+
+   void setPhduKeywords(Ft1File & lle, const std::string & outfile) const;
+
+   /// Process merit chunks from a directory as they arrive, updating
+   /// the LLE file after each one.
+   void followDirectory(const std::string & dirname,
+                        const std::string & outfile,
+                        const std::string & filter,
+                        const ::LLEMap_t & lleDict,
+                        const fitsGenApps::PsfCut & psf_cut,
+                        double tmin, double tmax) const;
+
+   void createLLEFile(const std::string & outfile,
+                      const std::string & dirname,
+                      const std::string & filter,
+                      const ::LLEMap_t & lleDict,
+                      double tmin, double tstop) const;
+
+   /// @return Number of events from meritFile appended to outfile.
+   long appendChunk(const std::string & outfile,
+                    const std::string & meritFile,
+                    const std::string & filter,
+                    const ::LLEMap_t & lleDict,
+                    const fitsGenApps::PsfCut & psf_cut,
+                    double tmin, double tmax) const;
+
+   void updateStopTime(const std::string & outfile,
+                       double tmin, double tstop) const;
 };
 
 std::string MakeLLE::s_cvs_id("$Name$");
@@ -236,6 +318,12 @@ void MakeLLE::run() {
    double dec = m_pars["dec"];
    fitsGenApps::PsfCut psf_cut(ft2file, ra, dec);
 
+   bool follow = m_pars["follow"];
+   if (follow) {
+      followDirectory(infile, outfile, filter, lleDict, psf_cut, tmin, tmax);
+      return;
+   }
+
    dataSubselector::Cuts my_cuts;
    Ft1File lle(outfile, 0, "EVENTS", "lle.tpl");
 
@@ -281,6 +369,16 @@ void MakeLLE::run() {
    my_cuts.addGtiCut(gti);
    my_cuts.writeDssKeywords(lle.header());
 
+   setPhduKeywords(lle, outfile);
+   
+   my_cuts.writeGtiExtension(outfile);
+   st_facilities::FitsUtil::writeChecksums(outfile);
+
+   delete merit_ptr;
+}
+
+void MakeLLE::setPhduKeywords(Ft1File & lle,
+                              const std::string & outfile) const {
    std::ostringstream creator;
    creator << "makeLLE " << getVersion();
    lle.setPhduKeyword("CREATOR", creator.str());
@@ -290,9 +388,158 @@ void MakeLLE::run() {
    lle.setPhduKeyword("FILENAME", filename);
    unsigned int proc_ver = m_pars["proc_ver"];
    lle.setPhduKeyword("PROC_VER", proc_ver);
-   
+}
+
+void MakeLLE::followDirectory(const std::string & dirname,
+                              const std::string & outfile,
+                              const std::string & filter,
+                              const ::LLEMap_t & lleDict,
+                              const fitsGenApps::PsfCut & psf_cut,
+                              double tmin, double tmax) const {
+   st_stream::StreamFormatter formatter("MakeLLE", "followDirectory", 2);
+   int poll_interval = m_pars["poll_interval"];
+   double idle_timeout = m_pars["idle_timeout"];
+
+// A chunk is taken to be complete once its size is unchanged between
+// two successive polls.  Chunks are assumed to arrive in time order.
+   std::map<std::string, long> pending;
+   std::set<std::string> processed;
+   bool created(false);
+   long ncount(0);
+   double tcovered(tmin);
+   double idle(0);
+   while (tcovered < tmax && idle < idle_timeout) {
+      std::vector<std::string> chunks;
+      ::listMeritChunks(dirname, chunks);
+      bool updated(false);
+      for (size_t i(0); i < chunks.size(); i++) {
+         const std::string & chunk(chunks[i]);
+         if (processed.count(chunk)) {
+            continue;
+         }
+         long size(::fileSize(chunk));
+         std::map<std::string, long>::iterator previous(pending.find(chunk));
+         if (size <= 0 || previous == pending.end() 
+             || previous->second != size) {
+            pending[chunk] = size;
+            continue;
+         }
+         pending.erase(previous);
+         processed.insert(chunk);
+         double chunk_stop(std::min(::chunkStopTime(chunk), tmax));
+         if (!created) {
+            createLLEFile(outfile, dirname, filter, lleDict, tmin,
+                          std::max(tmin, chunk_stop));
+            created = true;
+         }
+         long nadded(appendChunk(outfile, chunk, filter, lleDict,
+                                 psf_cut, tmin, tmax));
+         ncount += nadded;
+         tcovered = std::max(tcovered, chunk_stop);
+         updated = true;
+         formatter.info() << chunk << ": " << nadded 
+                          << " events accepted" << std::endl;
+      }
+      if (updated) {
+         updateStopTime(outfile, tmin, tcovered);
+         formatter.info() << std::setprecision(14)
+                          << "LLE file now covers " << tmin 
+                          << " to " << tcovered << "; " 
+                          << ncount << " events total" << std::endl;
+         idle = 0;
+      } else if (tcovered < tmax) {
+         sleep(poll_interval);
+         idle += poll_interval;
+      }
+   }
+   if (!created) {
+      throw std::runtime_error("No merit chunks arrived in " + dirname);
+   }
+   if (tcovered < tmax) {
+      formatter.info() << "No new merit chunks for " << idle_timeout
+                       << " s; stopping." << std::endl;
+   }
+   formatter.info() << "Number of events accepted: " << ncount << std::endl;
+}
+
+void MakeLLE::createLLEFile(const std::string & outfile,
+                            const std::string & dirname,
+                            const std::string & filter,
+                            const ::LLEMap_t & lleDict,
+                            double tmin, double tstop) const {
+   Ft1File lle(outfile, 0, "EVENTS", "lle.tpl");
+   lle.setObsTimes(tmin, tstop);
+   ::addNeededFields(lle, lleDict);
+   lle.header().addHistory("Input directory: " + dirname);
+   lle.header().addHistory("Filter string: " + filter);
+
+   dataSubselector::Gti gti;
+   gti.insertInterval(tmin, tstop);
+   dataSubselector::Cuts my_cuts;
+   my_cuts.addGtiCut(gti);
+   my_cuts.writeDssKeywords(lle.header());
+
+   setPhduKeywords(lle, outfile);
+   lle.close();
+
    my_cuts.writeGtiExtension(outfile);
-   st_facilities::FitsUtil::writeChecksums(outfile);
+}
 
-   delete merit_ptr;
+long MakeLLE::appendChunk(const std::string & outfile,
+                          const std::string & meritFile,
+                          const std::string & filter,
+                          const ::LLEMap_t & lleDict,
+                          const fitsGenApps::PsfCut & psf_cut,
+                          double tmin, double tmax) const {
+   MeritFile2 merit(meritFile, "MeritTuple", filter);
+   if (merit.nrows() == 0) {
+      return 0;
+   }
+   bool apply_psf = m_pars["apply_psf"];
+   dataSubselector::Gti gti;
+   gti.insertInterval(tmin, tmax);
+
+   tip::Table * events 
+      = tip::IFileSvc::instance().editTable(outfile, "EVENTS");
+   tip::Index_t nrows(events->getNumRecords());
+   events->setNumRecords(nrows + merit.nrows());
+   tip::Table::Iterator it = events->begin();
+   for (tip::Index_t i(0); i < nrows; i++) {
+      ++it;
+   }
+   tip::TableRecord & row = *it;
+
+   long ncount(0);
+   do {
+      double time = merit["EvtElapsedTime"];
+      double energy = merit["EvtEnergyCorr"];
+      double ra = merit["FT1Ra"];
+      double dec = merit["FT1Dec"];
+      if (gti.accept(time) && (!apply_psf || psf_cut(energy, time, ra, dec))) {
+         for (::LLEMap_t::const_iterator variable = lleDict.begin();
+              variable != lleDict.end(); ++variable) {
+            row[variable->first].set(merit[variable->second.meritName()]);
+         }
+         ++it;
+         ncount++;
+      }
+   } while (merit.next() != merit.nrows());
+   events->setNumRecords(nrows + ncount);
+   delete events;
+   return ncount;
+}
+
+void MakeLLE::updateStopTime(const std::string & outfile,
+                             double tmin, double tstop) const {
+   const char * extnames[] = {"", "EVENTS"};
+   for (size_t i(0); i < 2; i++) {
+      tip::Extension * hdu 
+         = tip::IFileSvc::instance().editExtension(outfile, extnames[i]);
+      hdu->getHeader()["TSTOP"].set(tstop);
+      delete hdu;
+   }
+   dataSubselector::Gti gti;
+   gti.insertInterval(tmin, tstop);
+   gti.writeExtension(outfile);
+   st_facilities::FitsUtil::writeChecksums(outfile);
 }
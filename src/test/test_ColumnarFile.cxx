@@ -0,0 +1,175 @@
+/**
+ * @file test_ColumnarFile.cxx
+ * @brief Round trip of the irfTuple columnar format through
+ * ColumnarWriter and the installed ColumnarReader.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <csignal>
+#include <cstdio>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "fitsGenApps/ColumnarFile.h"
+
+#include "irfTuple/ColumnarWriter.h"
+
+using fitsGenApps::ColumnarField;
+using fitsGenApps::ColumnarReader;
+using fitsGenApps::ColumnarWriter;
+
+namespace {
+   int nfailed(0);
+
+   void check(const std::string & name, bool ok) {
+      std::cout << (ok ? "ok      " : "FAILED  ") << name << std::endl;
+      if (!ok) {
+         nfailed++;
+      }
+   }
+
+/// @return true if reading filename throws.
+   bool readFails(const std::string & filename) {
+      try {
+         ColumnarReader reader(filename);
+      } catch (std::runtime_error &) {
+         return true;
+      }
+      return false;
+   }
+
+   double value(size_t col, uint64_t row) {
+      return 1e3*col + row + 1./(row + 3.);
+   }
+
+   std::vector<std::string> names() {
+      std::vector<std::string> columns;
+      columns.push_back("TIME");
+      columns.push_back("McEnergy");
+      columns.push_back("WEIGHT");
+      return columns;
+   }
+
+   std::vector<ColumnarField::Type> types() {
+      std::vector<ColumnarField::Type> columns(3, ColumnarField::FLOAT32);
+      columns[0] = ColumnarField::FLOAT64;
+      return columns;
+   }
+} // anonymous namespace
+
+int main() {
+   const std::string filename("test_ColumnarFile.dat");
+   const uint64_t capacity(1000);
+   const uint64_t nrows(137);
+
+// Fewer rows than the capacity, so that close() compacts the columns.
+   {
+      ColumnarWriter writer(filename, names(), types(), capacity);
+      for (uint64_t row(0); row < nrows; row++) {
+         for (size_t col(0); col < 3; col++) {
+            writer.set(col, row, value(col, row));
+         }
+      }
+      writer.close(nrows);
+   }
+   {
+      ColumnarReader reader(filename);
+      check("number of rows", reader.nrows() == nrows);
+      check("column names", reader.ncols() == 3 && reader.name(0) == "TIME"
+            && reader.name(1) == "McEnergy" && reader.name(2) == "WEIGHT");
+      const double * time(reader.doubleColumn("TIME"));
+      const float * energy(reader.floatColumn("McEnergy"));
+      const float * weight(reader.floatColumn("WEIGHT"));
+      bool same(true);
+      for (uint64_t row(0); row < nrows; row++) {
+         same = (same && time[row] == value(0, row)
+                 && energy[row] == static_cast<float>(value(1, row))
+                 && weight[row] == static_cast<float>(value(2, row)));
+      }
+      check("values", same);
+      check("column alignment",
+            reinterpret_cast<uintptr_t>(time) % 64 == 0
+            && reinterpret_cast<uintptr_t>(energy) % 64 == 0
+            && reinterpret_cast<uintptr_t>(weight) % 64 == 0);
+      bool wrong_type(false);
+      try {
+         reader.floatColumn("TIME");
+      } catch (std::runtime_error &) {
+         wrong_type = true;
+      }
+      check("wrong column type throws", wrong_type);
+      bool missing(false);
+      try {
+         reader.columnIndex("CTBCORE");
+      } catch (std::runtime_error &) {
+         missing = true;
+      }
+      check("missing column throws", missing);
+   }
+
+   bool overflow(false);
+   try {
+      ColumnarWriter writer(filename, names(), types(), 10);
+      writer.close(11);
+   } catch (std::runtime_error &) {
+      overflow = true;
+   }
+   check("closing with more rows than allocated throws", overflow);
+
+   {
+      ColumnarWriter writer(filename, names(), types(), capacity);
+      writer.close(0);
+   }
+   {
+      ColumnarReader reader(filename);
+      check("empty file", reader.nrows() == 0 && reader.ncols() == 3);
+   }
+
+   {
+      ColumnarWriter writer(filename, names(), types(), capacity);
+      writer.close(nrows);
+   }
+   check("truncated file throws",
+         truncate(filename.c_str(), 400) == 0 && readFails(filename));
+   {
+      std::FILE * file(std::fopen(filename.c_str(), "w"));
+      std::fputs("SIMPLE  =                    T", file);
+      std::fclose(file);
+   }
+   check("other file format throws", readFails(filename));
+   check("nonexistent file throws", readFails(filename + ".none"));
+
+// Space that cannot be allocated, simulated with a file size limit
+// rather than a full disk, must be reported when the writer is
+// created rather than as a signal when the map is written.
+   std::signal(SIGXFSZ, SIG_IGN);
+   struct rlimit limit;
+   getrlimit(RLIMIT_FSIZE, &limit);
+   struct rlimit small_limit(limit);
+   small_limit.rlim_cur = 1 << 20;
+   setrlimit(RLIMIT_FSIZE, &small_limit);
+   bool no_space(false);
+   try {
+      ColumnarWriter writer(filename, names(), types(), 1000000);
+   } catch (std::runtime_error &) {
+      no_space = true;
+   }
+   setrlimit(RLIMIT_FSIZE, &limit);
+   check("unallocatable capacity throws", no_space);
+
+   std::remove(filename.c_str());
+   if (nfailed > 0) {
+      std::cout << nfailed << " check(s) failed" << std::endl;
+      return 1;
+   }
+   return 0;
+}
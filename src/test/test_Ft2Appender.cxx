@@ -0,0 +1,135 @@
+/**
+ * @file test_Ft2Appender.cxx
+ * @brief Check the checksums of FT2 files extended by Ft2Appender,
+ * whose SC_DATA DATASUM is updated from the replaced and added rows
+ * alone, against cfitsio's verification and a full recomputation.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cstdio>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "fitsio.h"
+
+#include "st_facilities/FitsUtil.h"
+
+#include "fitsGen/Ft2File.h"
+
+#include "common/Ft2Appender.h"
+
+namespace {
+   int nfailed(0);
+
+   void check(const std::string & name, bool ok) {
+      std::cout << (ok ? "ok      " : "FAILED  ") << name << std::endl;
+      if (!ok) {
+         nfailed++;
+      }
+   }
+
+/// Write nrows 30 s rows starting at tstart.  Rows of different files
+/// are made to differ through offset.
+   void writeRows(const std::string & filename, double tstart, long nrows,
+                  double offset) {
+      fitsGen::Ft2File ft2(filename, nrows);
+      for (long i(0); i < nrows; i++, ft2.next()) {
+         double start(tstart + 30.*i);
+         ft2["start"].set(start);
+         ft2["stop"].set(start + 30.);
+         ft2["lat_geo"].set(-25. + 0.37*i + offset);
+         ft2["lon_geo"].set(0.91*i + offset);
+         ft2["rad_geo"].set(6.9e6 + i);
+         ft2["livetime"].set(29. - offset - 1e-3*i);
+         ft2["data_qual"].set(static_cast<int>(i % 3));
+         ft2["in_saa"].set(i % 5 == 0);
+      }
+      ft2.setObsTimes(tstart, tstart + 30.*nrows);
+   }
+
+/// @return true if cfitsio finds the DATASUM and CHECKSUM of every HDU
+///         present and correct.
+   bool checksumsValid(const std::string & filename) {
+      fitsfile * fptr(0);
+      int status(0);
+      fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+      int nhdus(0);
+      fits_get_num_hdus(fptr, &nhdus, &status);
+      bool valid(status == 0);
+      for (int hdu(1); hdu <= nhdus && valid; hdu++) {
+         int dataok(0), hduok(0);
+         fits_movabs_hdu(fptr, hdu, 0, &status);
+         fits_verify_chksum(fptr, &dataok, &hduok, &status);
+         valid = (status == 0 && dataok == 1 && hduok == 1);
+      }
+      int close_status(0);
+      fits_close_file(fptr, &close_status);
+      return valid;
+   }
+
+   std::string dataSum(const std::string & filename) {
+      fitsfile * fptr(0);
+      int status(0);
+      fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+      char extname[] = "SC_DATA";
+      fits_movnam_hdu(fptr, BINARY_TBL, extname, 0, &status);
+      char value[FLEN_VALUE] = "";
+      fits_read_key(fptr, TSTRING, "DATASUM", value, 0, &status);
+      fits_close_file(fptr, &status);
+      return status == 0 ? value : "";
+   }
+
+   long numRows(const std::string & filename) {
+      fitsfile * fptr(0);
+      int status(0);
+      fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+      char extname[] = "SC_DATA";
+      fits_movnam_hdu(fptr, BINARY_TBL, extname, 0, &status);
+      long nrows(-1);
+      fits_get_num_rows(fptr, &nrows, &status);
+      fits_close_file(fptr, &status);
+      return status == 0 ? nrows : -1;
+   }
+} // anonymous namespace
+
+int main() {
+   const std::string filename("test_Ft2Appender.fits");
+// Rows in the existing file, rows of it replaced, and rows appended,
+// including replacing every row and a file large enough that the
+// rows are summed in several chunks.
+   long cases[][3] = {{20, 1, 5}, {20, 0, 3}, {7, 7, 4}, {1, 1, 1},
+                      {30000, 2, 40000}};
+   for (size_t k(0); k < sizeof(cases)/sizeof(cases[0]); k++) {
+      long nrows(cases[k][0]), nreplace(cases[k][1]), nnew(cases[k][2]);
+      std::ostringstream name;
+      name << nrows << " rows, " << nreplace << " replaced, "
+           << nnew << " appended: ";
+      std::remove(filename.c_str());
+      writeRows(filename, 0, nrows, 0);
+      st_facilities::FitsUtil::writeChecksums(filename);
+      {
+         fitsGenApps::Ft2Appender appender(filename);
+         writeRows(appender.scratchFile(), 30.*(nrows - nreplace), nnew, 0.5);
+         appender.append(nreplace);
+      }
+      check(name.str() + "number of rows",
+            numRows(filename) == nrows - nreplace + nnew);
+      check(name.str() + "checksums verify", checksumsValid(filename));
+      std::string incremental(dataSum(filename));
+      st_facilities::FitsUtil::writeChecksums(filename);
+      check(name.str() + "DATASUM as recomputed in full",
+            incremental != "" && dataSum(filename) == incremental);
+   }
+
+   std::remove(filename.c_str());
+   if (nfailed > 0) {
+      std::cout << nfailed << " check(s) failed" << std::endl;
+      return 1;
+   }
+   return 0;
+}
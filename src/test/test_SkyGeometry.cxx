@@ -0,0 +1,197 @@
+/**
+ * @file test_SkyGeometry.cxx
+ * @brief Check the SkyGeometry column kernels against astro::SkyDir,
+ * CLHEP::Hep3Vector and the per-row add_source_info formulas they
+ * replace.
+ *
+ * @author J. Chiang
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CLHEP/Vector/ThreeVector.h"
+
+#include "astro/SkyDir.h"
+
+#include "common/SkyGeometry.h"
+
+using fitsGenApps::SkyGeometry;
+using fitsGenApps::UnitVectors;
+
+namespace {
+   const double deg(M_PI/180.);
+   const double tolerance(1e-9);
+
+   int nfailed(0);
+
+   void check(const std::string & name, double max_error) {
+      bool ok(max_error < tolerance);
+      std::cout << (ok ? "ok      " : "FAILED  ") << name
+                << ": maximum deviation " << max_error << " deg" << std::endl;
+      if (!ok) {
+         nfailed++;
+      }
+   }
+
+   double angle(const CLHEP::Hep3Vector & v1, const CLHEP::Hep3Vector & v2) {
+      return astro::SkyDir(v1).difference(astro::SkyDir(v2))/deg;
+   }
+
+   CLHEP::Hep3Vector vec(const UnitVectors & dirs, size_t i) {
+      return CLHEP::Hep3Vector(dirs.x[i], dirs.y[i], dirs.z[i]);
+   }
+
+/// Azimuthal difference, allowing for the wrap at 0/360.
+   double azimuthDiff(double phi1, double phi2) {
+      double diff(std::fabs(phi1 - phi2));
+      return std::min(diff, 360. - diff);
+   }
+
+/// Random directions, uniform on the sphere, plus the poles and
+/// points on the RA = 0/360 boundary.
+   void directions(size_t n, std::mt19937 & generator,
+                   std::vector<double> & ra, std::vector<double> & dec) {
+      std::uniform_real_distribution<double> uniform(0, 1);
+      ra.clear();
+      dec.clear();
+      double special[][2] = {{0, 90}, {0, -90}, {0, 0}, {359.9999999, 0},
+                             {180, 45}, {1e-9, -30}};
+      for (size_t i(0); i < sizeof(special)/sizeof(special[0]); i++) {
+         ra.push_back(special[i][0]);
+         dec.push_back(special[i][1]);
+      }
+      while (ra.size() < n) {
+         ra.push_back(360.*uniform(generator));
+         dec.push_back(std::asin(2.*uniform(generator) - 1.)/deg);
+      }
+   }
+} // anonymous namespace
+
+int main() {
+   const size_t n(100000);
+   std::mt19937 generator(20110901);
+
+   std::vector<double> ra, dec;
+   directions(n, generator, ra, dec);
+   UnitVectors dirs;
+   SkyGeometry::unitVectors(ra, dec, dirs);
+   double max_error(0);
+   for (size_t i(0); i < n; i++) {
+      astro::SkyDir expected(ra[i], dec[i]);
+      max_error = std::max(max_error, angle(vec(dirs, i), expected.dir()));
+   }
+   check("unitVectors vs SkyDir(ra, dec).dir()", max_error);
+
+// Scaled, not necessarily unit, vectors as for spacecraft positions
+   UnitVectors scaled(dirs);
+   for (size_t i(0); i < n; i++) {
+      scaled.x[i] *= 6.9e6;
+      scaled.y[i] *= 6.9e6;
+      scaled.z[i] *= 6.9e6;
+   }
+   std::vector<double> ra2, dec2;
+   SkyGeometry::raDec(scaled, ra2, dec2);
+   max_error = 0;
+   for (size_t i(0); i < n; i++) {
+      astro::SkyDir expected(vec(scaled, i));
+      max_error = std::max(max_error, astro::SkyDir(ra2[i], dec2[i])
+                           .difference(expected)/deg);
+   }
+   check("raDec vs SkyDir(vector).ra(), .dec()", max_error);
+
+   std::vector<double> ra_b, dec_b;
+   directions(n, generator, ra_b, dec_b);
+// Include nearly coincident directions, where an arccosine would lose
+// precision.
+   for (size_t i(0); i < n/10; i++) {
+      ra_b[i] = ra[i] + 1e-7*i/n;
+      dec_b[i] = dec[i];
+   }
+   UnitVectors dirs_b;
+   SkyGeometry::unitVectors(ra_b, dec_b, dirs_b);
+   std::vector<double> angles;
+   SkyGeometry::separations(dirs, dirs_b, angles);
+   max_error = 0;
+   for (size_t i(0); i < n; i++) {
+      double expected(astro::SkyDir(ra[i], dec[i])
+                      .difference(astro::SkyDir(ra_b[i], dec_b[i]))/deg);
+      max_error = std::max(max_error, std::fabs(angles[i] - expected));
+      max_error = std::max(max_error, 
+                           std::fabs(SkyGeometry::separation(ra[i], dec[i],
+                                                             ra_b[i], 
+                                                             dec_b[i])
+                                     - expected));
+   }
+   check("separations, separation vs SkyDir::difference", max_error);
+
+   UnitVectors poles;
+   SkyGeometry::cross(dirs, dirs_b, poles);
+   max_error = 0;
+   for (size_t i(n/10); i < n; i++) {
+      astro::SkyDir dir1(ra[i], dec[i]);
+      astro::SkyDir dir2(ra_b[i], dec_b[i]);
+      CLHEP::Hep3Vector expected(dir1.dir().cross(dir2.dir()));
+      max_error = std::max(max_error, angle(vec(poles, i), expected));
+      max_error = std::max(max_error, std::fabs(vec(poles, i).mag()
+                                                - expected.mag())/deg);
+   }
+   check("cross vs Hep3Vector::cross", max_error);
+
+// Pointing columns as in an FT2 file, with x-axes orthogonal to the
+// z-axes, and source directions from the second set of directions.
+// Both computations start from these columns, as add_source_info does.
+   std::vector<double> ra_scz(ra), dec_scz(dec), ra_scx(n), dec_scx(n);
+   for (size_t i(0); i < n; i++) {
+      astro::SkyDir x(astro::SkyDir(ra[i], dec[i]).dir().orthogonal());
+      ra_scx[i] = x.ra();
+      dec_scx[i] = x.dec();
+   }
+   UnitVectors zhat, xhat, yhat;
+   SkyGeometry::unitVectors(ra_scz, dec_scz, zhat);
+   SkyGeometry::unitVectors(ra_scx, dec_scx, xhat);
+   SkyGeometry::yAxes(zhat, xhat, yhat);
+
+   double theta_error(0), phi_error(0);
+   for (size_t k(0); k < 10; k++) {
+      astro::SkyDir srcDir(ra_b[n - 1 - k], dec_b[n - 1 - k]);
+      std::vector<double> theta, phi;
+      SkyGeometry::thetaPhi(zhat, xhat, yhat, srcDir.dir().x(),
+                            srcDir.dir().y(), srcDir.dir().z(), theta, phi);
+      for (size_t i(0); i < n; i++) {
+// The per-row computation of the original add_source_info, from the
+// pointing columns of the FT2 file.
+         astro::SkyDir z(ra_scz[i], dec_scz[i]);
+         astro::SkyDir x(ra_scx[i], dec_scx[i]);
+         astro::SkyDir y(-x.dir().cross(z.dir()));
+         double expected_theta(std::acos(srcDir.dir().dot(z.dir()))/deg);
+         double expected_phi(std::atan2(y.dir().dot(srcDir.dir()),
+                                        x.dir().dot(srcDir.dir()))/deg);
+         if (expected_phi < 0) {
+            expected_phi += 360.;
+         }
+         theta_error = std::max(theta_error,
+                                std::fabs(theta[i] - expected_theta));
+// The azimuth is undefined on the z-axis, and its error grows as
+// 1/sin(theta) towards it, so it is compared as an arc length.
+         phi_error = std::max(phi_error,
+                              azimuthDiff(phi[i], expected_phi)
+                              *std::sin(expected_theta*deg));
+      }
+   }
+   check("thetaPhi theta vs add_source_info", theta_error);
+   check("thetaPhi phi vs add_source_info", phi_error);
+
+   if (nfailed > 0) {
+      std::cout << nfailed << " check(s) failed" << std::endl;
+      return 1;
+   }
+   return 0;
+}